@@ -0,0 +1,69 @@
+// image_view.hpp
+// Non-owning, row-strided views of 2D images and integral tables.
+
+#ifndef IMAGE_VIEW_HPP
+#define IMAGE_VIEW_HPP
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Read-only view of a row-major image whose rows may be padded or belong to a
+ * larger frame (region of interest).
+ *
+ * stride is the distance between the starts of consecutive rows in BYTES and
+ * must be a multiple of alignof(T); 0 means tightly packed (width*sizeof(T)).
+ */
+template<class T>
+struct ImageView {
+    const T* data = nullptr;
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::size_t stride = 0;
+
+    ImageView() = default;
+    ImageView(const T* data_, std::size_t width_, std::size_t height_, std::size_t stride_ = 0) noexcept
+        : data(data_), width(width_), height(height_), stride(stride_ ? stride_ : width_*sizeof(T)) {}
+    /** Packed view of a w*h vector. */
+    ImageView(const std::vector<T>& v, std::size_t width_, std::size_t height_) noexcept
+        : ImageView(v.data(), width_, height_) {}
+
+    const T* row(std::size_t y) const noexcept{
+        return reinterpret_cast<const T*>(reinterpret_cast<const char*>(data) + y*stride);
+    }
+    const T& operator()(std::size_t x, std::size_t y) const noexcept{ return row(y)[x]; }
+
+    /** Sub-rectangle [x, x+w) x [y, y+h) sharing this view's memory and stride. */
+    ImageView roi(std::size_t x, std::size_t y, std::size_t w, std::size_t h) const noexcept{
+        return ImageView(row(y) + x, w, h, stride);
+    }
+};
+
+/** Writable counterpart of ImageView (e.g. a pre-allocated, padded or memory-mapped output). */
+template<class T>
+struct MutableImageView {
+    T* data = nullptr;
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::size_t stride = 0;
+
+    MutableImageView() = default;
+    MutableImageView(T* data_, std::size_t width_, std::size_t height_, std::size_t stride_ = 0) noexcept
+        : data(data_), width(width_), height(height_), stride(stride_ ? stride_ : width_*sizeof(T)) {}
+    /** Packed view of a w*h vector (the vector must already hold w*h elements). */
+    MutableImageView(std::vector<T>& v, std::size_t width_, std::size_t height_) noexcept
+        : MutableImageView(v.data(), width_, height_) {}
+
+    T* row(std::size_t y) const noexcept{
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(data) + y*stride);
+    }
+    T& operator()(std::size_t x, std::size_t y) const noexcept{ return row(y)[x]; }
+
+    MutableImageView roi(std::size_t x, std::size_t y, std::size_t w, std::size_t h) const noexcept{
+        return MutableImageView(row(y) + x, w, h, stride);
+    }
+
+    operator ImageView<T>() const noexcept{ return ImageView<T>(data, width, height, stride); }
+};
+
+#endif // IMAGE_VIEW_HPP
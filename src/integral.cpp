@@ -1,15 +1,21 @@
 // integral.cpp
 // Single- and multi-core integral image (summed-area table) computation
-// Build: g++ -O3 -std=c++17 -pthread -march=native -o integral src/integral.cpp
+// Build: g++ -O3 -std=c++17 -pthread -o integral src/integral.cpp src/integral_simd.cpp src/thread_pool.cpp src/integral_auto.cpp src/integral_tilted.cpp src/integral_rect.cpp src/integral_filters.cpp src/integral_histogram.cpp src/integral_update.cpp src/integral_stream.cpp src/integral_io.cpp src/integral_channels.cpp src/integral_alloc.cpp
+// SIMD row kernels are chosen at runtime (see integral_simd.cpp), so no -march flag is needed.
 // Optional: compile with -fopenmp to enable the OpenMP variant
 
 #include "integral.hpp"
+#include "integral_kernels.hpp"
+#include "thread_pool.hpp"
 
 #include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <random>
 #include <thread>
+#include <memory>
+#include <atomic>
+#include <mutex>
 #include <chrono>
 #include <iostream>
 #include <iomanip>
@@ -20,6 +26,9 @@
 #include <stdexcept>
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <limits>
 
 using std::size_t;
 using std::vector;
@@ -29,105 +38,759 @@ using std::cerr;
 using std::cout;
 using std::endl;
 
-void computeIntegralSingle(const std::vector<u32>& img, std::size_t w, std::size_t h, std::vector<u64>& integral) noexcept{
+template<class Pixel, class Acc>
+void computeIntegralSingle(ImageView<Pixel> img, MutableImageView<Acc> integral) noexcept{
+    const auto rowPrefix = integralKernels<Pixel, Acc>().rowPrefix;
+    for(size_t y=0;y<img.height;++y){
+        const Acc* above = (y>0) ? integral.row(y-1) : nullptr;
+        rowPrefix(img.row(y), above, integral.row(y), img.width, 0);
+    }
+}
+
+template<class Pixel, class Acc>
+void computeIntegralSingle(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral) noexcept{
     if(w==0 || h==0) { integral.clear(); return; }
-    integral.assign(w*h, 0);
-    for(size_t y=0;y<h;++y){
-        u64 row_sum = 0;
-        size_t base = y*w;
+    integral.resize(w*h);
+    computeIntegralSingle(ImageView<Pixel>(img, w, h), MutableImageView<Acc>(integral, w, h));
+}
+
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralSingle(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws) noexcept{
+    if(!ws.reserve(img.width, img.height, 1)) return ImageView<Acc>();
+    computeIntegralSingle(img, ws.output());
+    return ws.result();
+}
+
+// Tile width (pixels) of the band sweep: one tile of the previous output row
+// (kTileWidth accumulators) plus the matching input chunk stay resident in L1.
+static constexpr size_t kTileWidth = 1024;
+
+// Sum every column of rows [y0,y1) into colSum[0..w).
+template<class Pixel, class Acc>
+static void bandColumnSums(ImageView<Pixel> img, size_t y0, size_t y1, Acc* colSum) noexcept{
+    const auto columnSum = integralKernels<Pixel, Acc>().columnSum;
+    std::fill(colSum, colSum + img.width, Acc(0));
+    for(size_t y=y0;y<y1;++y) columnSum(img.row(y), colSum, img.width);
+}
+
+// Running totals of the column sums of all bands above each band, turned into
+// the integral row just above that band: tops[(b-1)*w + x] == I(y0(b)-1, x).
+// `carry` is w scratch accumulators.
+template<class Acc>
+static void bandTopRows(const Acc* colSum, size_t w, size_t bands, Acc* tops, Acc* carry) noexcept{
+    std::fill(carry, carry + w, Acc(0));
+    for(size_t b=1;b<bands;++b){
+        const Acc* cs = colSum + (b-1)*w;
+        Acc* top = tops + (b-1)*w;
+        Acc s = 0;
         for(size_t x=0;x<w;++x){
-            row_sum += img[base + x];
-            u64 above = (y>0) ? integral[(y-1)*w + x] : 0;
-            integral[base + x] = row_sum + above;
+            carry[x] += cs[x];
+            s += carry[x];
+            top[x] = s;
         }
     }
 }
 
-void computeIntegralMulti(const std::vector<u32>& img, std::size_t w, std::size_t h, std::vector<u64>& integral, int num_threads) noexcept{
-    if(w==0 || h==0) { integral.clear(); return; }
-    if(num_threads < 1) num_threads = 1;
-    integral.assign(w*h, 0);
-    vector<u64> rowCum(w*h);
+// Write integral rows [y0,y1) tile by tile. `top` is the integral row y0-1
+// (nullptr for the first band); the running row sum of each row is carried
+// from one tile to the next in rowCarry[0..y1-y0), the previous output row
+// from one row to the next.
+template<class Pixel, class Acc>
+static void integralBand(ImageView<Pixel> img, size_t y0, size_t y1, const Acc* top, MutableImageView<Acc> integral, Acc* rowCarry) noexcept{
+    const auto rowPrefix = integralKernels<Pixel, Acc>().rowPrefix;
+    const size_t w = img.width;
+    std::fill(rowCarry, rowCarry + (y1 - y0), Acc(0));
+    for(size_t x0=0;x0<w;x0+=kTileWidth){
+        size_t n = std::min(w - x0, kTileWidth);
+        const Acc* prev = top ? top + x0 : nullptr;
+        for(size_t y=y0;y<y1;++y){
+            Acc* out = integral.row(y) + x0;
+            rowCarry[y-y0] = rowPrefix(img.row(y) + x0, prev, out, n, rowCarry[y-y0]);
+            prev = out;
+        }
+    }
+}
+
+// CPU for each of num_threads threads: nodes get contiguous runs of thread
+// indices in proportion, filled with the node's CPUs in order (wrapping round
+// when a node has fewer CPUs than threads).
+static vector<int> numaThreadCpus(int num_threads){
+    const vector<vector<int>> nodes = numaNodeCpus();
+    const size_t threads = static_cast<size_t>(std::max(num_threads, 1));
+    const size_t used = std::min(nodes.size(), threads);
+    vector<int> cpus(threads);
+    for(size_t t=0;t<threads;++t){
+        size_t node = t*used/threads;
+        size_t first = (node*threads + used - 1)/used;
+        cpus[t] = nodes[node][(t - first) % nodes[node].size()];
+    }
+    return cpus;
+}
+
+IntegralEngine::IntegralEngine(int num_threads, ThreadPlacement placement)
+    : pool_(new ThreadPool(num_threads, placement == ThreadPlacement::Numa ? numaThreadCpus(num_threads) : vector<int>())),
+      placement_(placement) {}
+
+IntegralEngine::~IntegralEngine() = default;
+
+int IntegralEngine::threads() const noexcept{
+    return pool_->size();
+}
+
+int IntegralEngine::threadCpu(int t) const noexcept{
+    return t < 0 ? -1 : pool_->cpu(static_cast<size_t>(t));
+}
+
+// Threads a call may use: the pool size, or fewer when the caller asks for it.
+static size_t callThreads(const ThreadPool& pool, int num_threads) noexcept{
+    if(num_threads < 1 || num_threads > pool.size()) num_threads = pool.size();
+    return static_cast<size_t>(num_threads);
+}
+
+// Rows per band (or columns per strip, before rounding) when splitting `extent`
+// for `threads` threads: up to kTasksPerThread tasks per thread for work
+// stealing, but no thinner than `min_size` unless one task per thread already is.
+static size_t taskSize(size_t extent, size_t threads, size_t min_size) noexcept{
+    size_t tasks = IntegralWorkspace<u32>::maxTasks(static_cast<int>(threads));
+    size_t fine = (extent + tasks - 1) / tasks;
+    size_t coarse = (extent + threads - 1) / threads;
+    return std::max(fine, std::min(min_size, coarse));
+}
 
-    // Phase 1: per-row prefix sums
-    auto worker_rows = [&](int tid){
-        size_t rows_per = (h + num_threads - 1) / num_threads;
-        size_t y0 = tid * rows_per;
+// Uninitialised scratch for a call without a workspace (no zero-fill); empty
+// when out of memory, in which case the callers fall back to the
+// single-threaded pass, which needs no scratch.
+template<class Acc>
+static BufferPtr<Acc> callScratch(size_t w, size_t h, size_t threads) noexcept{
+    return makeBuffer<Acc>(IntegralWorkspace<Acc>::scratchSize(w, h, static_cast<int>(threads)), BufferPages::Default);
+}
+
+// Band engine. scratch holds IntegralWorkspace<Acc>::scratchSize(w, h, threads)
+// accumulators: column sums and top rows of the bands, a column carry, and one
+// running row sum per row.
+template<class Pixel, class Acc>
+static void computeBands(ThreadPool& pool, size_t threads, ImageView<Pixel> img, MutableImageView<Acc> integral, Acc* scratch) noexcept{
+    const size_t w = img.width, h = img.height;
+    if(w==0 || h==0) return;
+
+    size_t rows_per = taskSize(h, threads, IntegralEngine::kMinBandRows);
+    size_t bands = (h + rows_per - 1) / rows_per;
+    Acc* colSum = scratch;
+    Acc* tops = colSum + (bands-1)*w;
+    Acc* carry = tops + (bands-1)*w;
+    Acc* rowCarry = carry + w;
+    if(bands == 1){
+        integralBand<Pixel, Acc>(img, 0, h, nullptr, integral, rowCarry);
+        return;
+    }
+
+    // Phase 1: column sums of every band but the last
+    pool.run(bands-1, [&](size_t b){
+        bandColumnSums(img, b*rows_per, (b+1)*rows_per, colSum + b*w);
+    }, static_cast<int>(threads));
+
+    bandTopRows(colSum, w, bands, tops, carry);
+
+    // Phase 2: each band writes its rows exactly once, starting from its top row
+    pool.run(bands, [&](size_t b){
+        size_t y0 = b*rows_per;
         size_t y1 = std::min(h, y0 + rows_per);
-        for(size_t y=y0;y<y1;++y){
-            u64 s = 0;
-            size_t base = y*w;
-            for(size_t x=0;x<w;++x){
-                s += img[base + x];
-                rowCum[base + x] = s;
-            }
+        integralBand<Pixel, Acc>(img, y0, y1, b ? tops + (b-1)*w : nullptr, integral, rowCarry + y0);
+    }, static_cast<int>(threads));
+}
+
+// Strip engine. scratch holds IntegralWorkspace<Acc>::scratchSize(w, h, threads)
+// accumulators: per-row sums of the strips and the running row sum entering each.
+template<class Pixel, class Acc>
+static void computeStripsImpl(ThreadPool& pool, size_t threads, ImageView<Pixel> img, MutableImageView<Acc> integral, Acc* scratch) noexcept{
+    const size_t w = img.width, h = img.height;
+    if(w==0 || h==0) return;
+
+    // strips are a whole number of cache lines of output wide
+    size_t cols_per = taskSize(w, threads, IntegralEngine::kMinStripCols);
+    cols_per = (cols_per + 7) & ~size_t(7);
+    size_t strips = (w + cols_per - 1) / cols_per;
+    const IntegralKernels<Pixel, Acc>& k = integralKernels<Pixel, Acc>();
+    Acc* rowSums = scratch;
+    Acc* left = rowSums + (strips-1)*h;
+
+    // Phase 1: per-row sums of every strip but the last
+    pool.run(strips-1, [&](size_t s){
+        size_t x0 = s*cols_per;
+        for(size_t y=0;y<h;++y) rowSums[s*h + y] = k.rowSum(img.row(y) + x0, cols_per);
+    }, static_cast<int>(threads));
+
+    // running row sum entering each strip: left[(s-1)*h + y]
+    for(size_t s=1;s<strips;++s){
+        for(size_t y=0;y<h;++y) left[(s-1)*h + y] = rowSums[(s-1)*h + y] + (s>1 ? left[(s-2)*h + y] : 0);
+    }
+
+    // Phase 2: each strip streams down its rows, adding the previous output row
+    pool.run(strips, [&](size_t s){
+        size_t x0 = s*cols_per;
+        size_t n = std::min(w - x0, cols_per);
+        const Acc* prev = nullptr;
+        for(size_t y=0;y<h;++y){
+            Acc* out = integral.row(y) + x0;
+            k.rowPrefix(img.row(y) + x0, prev, out, n, s ? left[(s-1)*h + y] : 0);
+            prev = out;
         }
-    };
+    }, static_cast<int>(threads));
+}
 
-    vector<std::thread> threads;
-    for(int t=0;t<num_threads;++t) threads.emplace_back(worker_rows, t);
-    for(auto &th: threads) th.join();
-
-    // Phase 2: per-column prefix sums over rowCum -> integral
-    auto worker_cols = [&](int tid){
-        size_t cols_per = (w + num_threads - 1) / num_threads;
-        size_t x0 = tid * cols_per;
-        size_t x1 = std::min(w, x0 + cols_per);
-        for(size_t x=x0;x<x1;++x){
-            u64 s = 0;
-            for(size_t y=0;y<h;++y){
-                s += rowCum[y*w + x];
-                integral[y*w + x] = s;
+// Block split of the look-back engine. A block's input is about half the L2
+// (256 KiB assumed when sysfs has no size), so the sweep re-reads it from
+// cache; very wide rows give blocks of a row or two, each paying a few extra
+// passes over one row of sums.
+struct LookBackPlan {
+    size_t rows_per, blocks, threads;
+    // per block: aggregate and inclusive column sums; per participant: the
+    // exclusive sums, the top row built from them and the band's row carries
+    // (a single block only needs the row carries)
+    size_t scratch(size_t w, size_t h) const noexcept{
+        return blocks == 1 ? h : blocks*2*w + threads*(2*w + rows_per);
+    }
+};
+
+static LookBackPlan lookBackPlan(size_t w, size_t h, size_t pixelBytes, size_t threads) noexcept{
+    static const size_t l2 = cacheSizes().l2 ? cacheSizes().l2 : (size_t(256) << 10);
+    if(w==0 || h==0) return {0, 0, 0};
+    size_t rows_per = std::max<size_t>(1, l2 / 2 / (w*pixelBytes));
+    rows_per = std::min(rows_per, (h + threads - 1) / threads);
+    size_t blocks = (h + rows_per - 1) / rows_per;
+    return {rows_per, blocks, std::min(threads, blocks)};
+}
+
+// Look-back engine: blocks are taken in order from a ticket counter. Block k
+// sums its columns, publishes them as its aggregate, then walks back over its
+// predecessors adding aggregates until it meets an inclusive prefix (the
+// column sums of all rows above its end). Once its own inclusive prefix is
+// published it sweeps its rows from the top row built from the exclusive one,
+// while its input is still in cache. No thread waits for a phase to finish;
+// block k only waits for blocks holding lower tickets, which are always
+// running, so any number of threads makes progress. scratch holds
+// plan.scratch(w, h) accumulators, status plan.blocks flags.
+template<class Pixel, class Acc>
+static void computeLookBackImpl(ThreadPool& pool, const LookBackPlan& plan, ImageView<Pixel> img, MutableImageView<Acc> integral, Acc* scratch, std::atomic<u32>* status) noexcept{
+    const size_t w = img.width, h = img.height;
+    if(w==0 || h==0) return;
+    const size_t rows_per = plan.rows_per, blocks = plan.blocks;
+    if(blocks == 1){
+        integralBand<Pixel, Acc>(img, 0, h, nullptr, integral, scratch);
+        return;
+    }
+
+    enum : u32 { kPending = 0, kAggregate = 1, kInclusive = 2 };
+    for(size_t k=0;k<blocks;++k) status[k].store(kPending, std::memory_order_relaxed);
+    auto aggregateOf = [&](size_t k){ return scratch + k*2*w; };
+    auto inclusiveOf = [&](size_t k){ return aggregateOf(k) + w; };
+    std::atomic<size_t> ticket(0);
+    const auto rowPrefix = integralKernels<Acc, Acc>().rowPrefix;
+
+    pool.run(plan.threads, [&](size_t t){
+        Acc* exclusive = scratch + blocks*2*w + t*(2*w + rows_per);
+        Acc* top = exclusive + w;
+        Acc* rowCarry = top + w;
+        for(size_t k;(k = ticket.fetch_add(1, std::memory_order_relaxed)) < blocks;){
+            size_t y0 = k*rows_per;
+            size_t y1 = std::min(h, y0 + rows_per);
+            Acc* aggregate = aggregateOf(k);
+            const bool last = k + 1 == blocks;
+            // nobody looks back past the last block, so it skips its own sums
+            if(!last) bandColumnSums(img, y0, y1, aggregate);
+            if(k == 0){
+                std::copy(aggregate, aggregate + w, inclusiveOf(0));
+                status[0].store(kInclusive, std::memory_order_release);
+                integralBand<Pixel, Acc>(img, y0, y1, nullptr, integral, rowCarry);
+                continue;
             }
+            if(!last) status[k].store(kAggregate, std::memory_order_release);
+
+            std::fill(exclusive, exclusive + w, Acc(0));
+            for(size_t j=k-1;;--j){
+                u32 s;
+                while((s = status[j].load(std::memory_order_acquire)) == kPending) std::this_thread::yield();
+                const Acc* part = s == kInclusive ? inclusiveOf(j) : aggregateOf(j);
+                for(size_t x=0;x<w;++x) exclusive[x] += part[x];
+                if(s == kInclusive) break;
+            }
+            if(!last){
+                Acc* inclusive = inclusiveOf(k);
+                for(size_t x=0;x<w;++x) inclusive[x] = exclusive[x] + aggregate[x];
+                status[k].store(kInclusive, std::memory_order_release);
+            }
+
+            rowPrefix(exclusive, nullptr, top, w, Acc(0));
+            integralBand<Pixel, Acc>(img, y0, y1, top, integral, rowCarry);
         }
-    };
-    threads.clear();
-    for(int t=0;t<num_threads;++t) threads.emplace_back(worker_cols, t);
-    for(auto &th: threads) th.join();
+    }, static_cast<int>(plan.threads));
+}
+
+template<class Acc>
+void IntegralEngine::firstTouch(MutableImageView<Acc> table, int num_threads) noexcept{
+    const size_t w = table.width, h = table.height;
+    if(w==0 || h==0) return;
+    size_t threads = callThreads(*pool_, num_threads);
+    size_t rows_per = taskSize(h, threads, IntegralEngine::kMinBandRows);
+    size_t bands = (h + rows_per - 1) / rows_per;
+    pool_->run(bands, [&](size_t b){
+        for(size_t y=b*rows_per;y<std::min(h, (b+1)*rows_per);++y) std::fill(table.row(y), table.row(y) + w, Acc(0));
+    }, static_cast<int>(threads));
+}
+
+template<class Pixel, class Acc>
+void IntegralEngine::compute(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept{
+    size_t threads = callThreads(*pool_, num_threads);
+    BufferPtr<Acc> scratch = callScratch<Acc>(img.width, img.height, threads);
+    if(!scratch) { computeIntegralSingle(img, integral); return; }
+    computeBands(*pool_, threads, img, integral, scratch.get());
+}
+
+template<class Pixel, class Acc>
+ImageView<Acc> IntegralEngine::compute(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads) noexcept{
+    size_t threads = callThreads(*pool_, num_threads);
+    if(!ws.reserve(img.width, img.height, static_cast<int>(threads))) return ImageView<Acc>();
+    computeBands(*pool_, threads, img, ws.output(), ws.scratch());
+    return ws.result();
+}
+
+template<class Pixel, class Acc>
+void IntegralEngine::compute(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept{
+    if(w==0 || h==0) { integral.clear(); return; }
+    integral.resize(w*h);
+    compute(ImageView<Pixel>(img, w, h), MutableImageView<Acc>(integral, w, h), num_threads);
+}
+
+template<class Pixel, class Acc>
+void IntegralEngine::computeStrips(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept{
+    size_t threads = callThreads(*pool_, num_threads);
+    BufferPtr<Acc> scratch = callScratch<Acc>(img.width, img.height, threads);
+    if(!scratch) { computeIntegralSingle(img, integral); return; }
+    computeStripsImpl(*pool_, threads, img, integral, scratch.get());
+}
+
+template<class Pixel, class Acc>
+ImageView<Acc> IntegralEngine::computeStrips(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads) noexcept{
+    size_t threads = callThreads(*pool_, num_threads);
+    if(!ws.reserve(img.width, img.height, static_cast<int>(threads))) return ImageView<Acc>();
+    computeStripsImpl(*pool_, threads, img, ws.output(), ws.scratch());
+    return ws.result();
+}
+
+template<class Pixel, class Acc>
+void IntegralEngine::computeStrips(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept{
+    if(w==0 || h==0) { integral.clear(); return; }
+    integral.resize(w*h);
+    computeStrips(ImageView<Pixel>(img, w, h), MutableImageView<Acc>(integral, w, h), num_threads);
+}
+
+template<class Pixel, class Acc>
+void IntegralEngine::computeLookBack(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept{
+    const LookBackPlan plan = lookBackPlan(img.width, img.height, sizeof(Pixel), callThreads(*pool_, num_threads));
+    if(plan.blocks == 0) return;
+    BufferPtr<Acc> scratch = makeBuffer<Acc>(plan.scratch(img.width, img.height), BufferPages::Default);
+    std::unique_ptr<std::atomic<u32>[]> status(new(std::nothrow) std::atomic<u32>[plan.blocks]);
+    if(!scratch || !status) { computeIntegralSingle(img, integral); return; }
+    computeLookBackImpl(*pool_, plan, img, integral, scratch.get(), status.get());
+}
+
+template<class Pixel, class Acc>
+ImageView<Acc> IntegralEngine::computeLookBack(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads) noexcept{
+    const size_t threads = callThreads(*pool_, num_threads);
+    const LookBackPlan plan = lookBackPlan(img.width, img.height, sizeof(Pixel), threads);
+    if(!ws.reserve(img.width, img.height, static_cast<int>(threads))
+       || !ws.reserveScratch(plan.scratch(img.width, img.height), plan.blocks)) return ImageView<Acc>();
+    computeLookBackImpl(*pool_, plan, img, ws.output(), ws.scratch(), ws.flags());
+    return ws.result();
+}
+
+template<class Pixel, class Acc>
+void IntegralEngine::computeLookBack(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept{
+    if(w==0 || h==0) { integral.clear(); return; }
+    integral.resize(w*h);
+    computeLookBack(ImageView<Pixel>(img, w, h), MutableImageView<Acc>(integral, w, h), num_threads);
+}
+
+template<class Pixel, class Acc>
+void IntegralEngine::computeBatch(const ImageView<Pixel>* images, const MutableImageView<Acc>* integrals, std::size_t count, int num_threads) noexcept{
+    if(count == 0) return;
+    const size_t threads = callThreads(*pool_, num_threads);
+    if(threads == 1 || count == 1){
+        for(size_t i=0;i<count;++i) computeIntegralSingle(images[i], integrals[i]);
+        return;
+    }
+    // Largest images first (longest-processing-time order): the big ones start
+    // early and the small ones even out the finish. Without memory for the
+    // order the images run as given.
+    BufferPtr<size_t> order = makeBuffer<size_t>(count, BufferPages::Default);
+    if(order){
+        std::iota(order.get(), order.get() + count, size_t(0));
+        std::stable_sort(order.get(), order.get() + count, [&](size_t a, size_t b){
+            return images[a].width*images[a].height > images[b].width*images[b].height;
+        });
+    }
+    pool_->run(count, [&](size_t i){
+        size_t k = order ? order[i] : i;
+        computeIntegralSingle(images[k], integrals[k]);
+    }, static_cast<int>(threads));
+}
+
+// bandColumnSums for both tables: every kTileWidth chunk of a row is squared
+// into an L1 buffer while it is still cached, so the row is read from memory once.
+template<class Pixel, class Acc, class Sq>
+static void bandColumnSumsSquared(ImageView<Pixel> img, size_t y0, size_t y1, Acc* colSum, Sq* colSumSq) noexcept{
+    using SqPixel = typename SquaredPixel<Pixel>::type;
+    const auto columnSum = integralKernels<Pixel, Acc>().columnSum;
+    const auto columnSumSq = integralKernels<SqPixel, Sq>().columnSum;
+    SqPixel sq[kTileWidth];
+    std::fill(colSum, colSum + img.width, Acc(0));
+    std::fill(colSumSq, colSumSq + img.width, Sq(0));
+    for(size_t y=y0;y<y1;++y){
+        const Pixel* row = img.row(y);
+        for(size_t x0=0;x0<img.width;x0+=kTileWidth){
+            size_t n = std::min(img.width - x0, kTileWidth);
+            columnSum(row + x0, colSum + x0, n);
+            squarePixels(row + x0, sq, n);
+            columnSumSq(sq, colSumSq + x0, n);
+        }
+    }
+}
+
+// integralBand for both tables, with the same tile-by-tile squaring.
+template<class Pixel, class Acc, class Sq>
+static void integralBandSquared(ImageView<Pixel> img, size_t y0, size_t y1, const Acc* top, const Sq* topSq,
+                                MutableImageView<Acc> integral, MutableImageView<Sq> squared, Acc* rowCarry, Sq* rowCarrySq) noexcept{
+    using SqPixel = typename SquaredPixel<Pixel>::type;
+    const auto rowPrefix = integralKernels<Pixel, Acc>().rowPrefix;
+    const auto rowPrefixSq = integralKernels<SqPixel, Sq>().rowPrefix;
+    SqPixel sq[kTileWidth];
+    const size_t w = img.width;
+    std::fill(rowCarry, rowCarry + (y1 - y0), Acc(0));
+    std::fill(rowCarrySq, rowCarrySq + (y1 - y0), Sq(0));
+    for(size_t x0=0;x0<w;x0+=kTileWidth){
+        size_t n = std::min(w - x0, kTileWidth);
+        const Acc* prev = top ? top + x0 : nullptr;
+        const Sq* prevSq = topSq ? topSq + x0 : nullptr;
+        for(size_t y=y0;y<y1;++y){
+            const Pixel* in = img.row(y) + x0;
+            Acc* out = integral.row(y) + x0;
+            Sq* outSq = squared.row(y) + x0;
+            rowCarry[y-y0] = rowPrefix(in, prev, out, n, rowCarry[y-y0]);
+            squarePixels(in, sq, n);
+            rowCarrySq[y-y0] = rowPrefixSq(sq, prevSq, outSq, n, rowCarrySq[y-y0]);
+            prev = out;
+            prevSq = outSq;
+        }
+    }
+}
+
+template<class Pixel, class Acc, class Sq>
+void IntegralEngine::computeSquared(ImageView<Pixel> img, MutableImageView<Acc> integral, MutableImageView<Sq> squared, int num_threads) noexcept{
+    const size_t w = img.width, h = img.height;
+    if(w==0 || h==0) return;
+    size_t threads = callThreads(*pool_, num_threads);
+
+    // same band split and scratch layout as computeBands, once per table
+    size_t rows_per = taskSize(h, threads, IntegralEngine::kMinBandRows);
+    size_t bands = (h + rows_per - 1) / rows_per;
+    BufferPtr<Acc> scratch = callScratch<Acc>(w, h, threads);
+    BufferPtr<Sq> scratchSq = callScratch<Sq>(w, h, threads);
+    Acc* colSum = scratch.get();
+    Acc* tops = colSum + (bands-1)*w;
+    Acc* carry = tops + (bands-1)*w;
+    Acc* rowCarry = carry + w;
+    Sq* colSumSq = scratchSq.get();
+    Sq* topsSq = colSumSq + (bands-1)*w;
+    Sq* carrySq = topsSq + (bands-1)*w;
+    Sq* rowCarrySq = carrySq + w;
+    if(!scratch || !scratchSq){
+        // out of memory for the scratch: one-row bands from the row above need
+        // only a running row sum per table
+        for(size_t y=0;y<h;++y){
+            Acc c;
+            Sq cs;
+            integralBandSquared<Pixel, Acc, Sq>(img, y, y+1, y ? integral.row(y-1) : nullptr, y ? squared.row(y-1) : nullptr, integral, squared, &c, &cs);
+        }
+        return;
+    }
+    if(bands == 1){
+        integralBandSquared<Pixel, Acc, Sq>(img, 0, h, nullptr, nullptr, integral, squared, rowCarry, rowCarrySq);
+        return;
+    }
+
+    pool_->run(bands-1, [&](size_t b){
+        bandColumnSumsSquared(img, b*rows_per, (b+1)*rows_per, colSum + b*w, colSumSq + b*w);
+    }, static_cast<int>(threads));
+
+    bandTopRows(colSum, w, bands, tops, carry);
+    bandTopRows(colSumSq, w, bands, topsSq, carrySq);
+
+    pool_->run(bands, [&](size_t b){
+        size_t y0 = b*rows_per;
+        size_t y1 = std::min(h, y0 + rows_per);
+        integralBandSquared<Pixel, Acc, Sq>(img, y0, y1, b ? tops + (b-1)*w : nullptr, b ? topsSq + (b-1)*w : nullptr,
+                                            integral, squared, rowCarry + y0, rowCarrySq + y0);
+    }, static_cast<int>(threads));
+}
+
+template<class Pixel, class Acc, class Sq>
+void IntegralEngine::computeSquared(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, std::vector<Sq>& squared, int num_threads) noexcept{
+    if(w==0 || h==0) { integral.clear(); squared.clear(); return; }
+    integral.resize(w*h);
+    squared.resize(w*h);
+    computeSquared(ImageView<Pixel>(img, w, h), MutableImageView<Acc>(integral, w, h), MutableImageView<Sq>(squared, w, h), num_threads);
+}
+
+// The engine only grows: it is rebuilt when a call asks for more threads than
+// it has, and smaller requests use a subset of its pool. Callers hold a
+// reference, so a replaced engine lives until its last in-flight call returns.
+std::shared_ptr<IntegralEngine> defaultIntegralEngine(int num_threads){
+    static std::mutex mutex;
+    static std::shared_ptr<IntegralEngine> engine;
+    if(num_threads < 1) num_threads = 1;
+    std::lock_guard<std::mutex> lk(mutex);
+    if(!engine || engine->threads() < num_threads){
+        // a larger engine that cannot be created (threads or memory) keeps the
+        // current one; callers clamp their thread count to its pool
+        try{ engine = std::make_shared<IntegralEngine>(num_threads); }
+        catch(...){ if(!engine) throw; }
+    }
+    return engine;
+}
+
+template<class Pixel, class Acc>
+void computeIntegralMulti(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->compute(img, integral, num_threads);
+}
+
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralMulti(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    return defaultIntegralEngine(num_threads)->compute(img, ws, num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeIntegralMulti(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->compute(img, w, h, integral, num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeIntegralStrips(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeStrips(img, integral, num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeIntegralStrips(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeStrips(img, w, h, integral, num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeIntegralLookBack(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeLookBack(img, integral, num_threads);
+}
+
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralLookBack(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    return defaultIntegralEngine(num_threads)->computeLookBack(img, ws, num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeIntegralLookBack(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeLookBack(img, w, h, integral, num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeIntegralBatch(const ImageView<Pixel>* images, const MutableImageView<Acc>* integrals, std::size_t count, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeBatch(images, integrals, count, num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeIntegralBatch(const std::vector<ImageView<Pixel>>& images, const std::vector<MutableImageView<Acc>>& integrals, int num_threads) noexcept{
+    computeIntegralBatch(images.data(), integrals.data(), std::min(images.size(), integrals.size()), num_threads);
+}
+
+template<class Pixel, class Acc, class Sq>
+void computeIntegralSquared(ImageView<Pixel> img, MutableImageView<Acc> integral, MutableImageView<Sq> squared, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeSquared(img, integral, squared, num_threads);
+}
+
+template<class Pixel, class Acc, class Sq>
+void computeIntegralSquared(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, std::vector<Sq>& squared, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeSquared(img, w, h, integral, squared, num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeIntegralPadded(ImageView<Pixel> img, MutableImageView<Acc> padded) noexcept{
+    const size_t w = img.width, h = img.height;
+    std::fill(padded.row(0), padded.row(0) + w + 1, Acc(0));
+    for(size_t y=1;y<=h;++y) padded(0, y) = Acc(0);
+    computeIntegralAuto(img, padded.roi(1, 1, w, h));
+}
+
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralPadded(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc, IntegralAllocator<Acc>>& padded, std::size_t align) noexcept{
+    const size_t stride = paddedIntegralStride<Acc>(w, align);
+    padded.resize((h + 1)*stride / sizeof(Acc));
+    MutableImageView<Acc> view(padded.data(), w + 1, h + 1, stride);
+    computeIntegralPadded(ImageView<Pixel>(img, w, h), view);
+    return view;
+}
+
+u64 integralMaxSum(std::size_t w, std::size_t h, unsigned bits) noexcept{
+    const u64 sat = std::numeric_limits<u64>::max();
+    if(w==0 || h==0 || bits==0) return 0;
+    u64 maxPixel = bits >= 64 ? sat : (u64(1) << bits) - 1;
+    if(h > sat / w) return sat;
+    u64 pixels = static_cast<u64>(w) * h;
+    if(pixels > sat / maxPixel) return sat;
+    return pixels * maxPixel;
+}
+
+template<class Pixel>
+NarrowIntegral computeIntegralNarrow(const std::vector<Pixel>& img, std::size_t w, std::size_t h, unsigned bits, bool allow_wrapping) noexcept{
+    if(bits == 0 || bits > 8*sizeof(Pixel)) bits = 8*sizeof(Pixel);
+    NarrowIntegral r;
+    bool fits = integralMaxSum(w, h, bits) <= std::numeric_limits<u32>::max();
+    r.wrapping = !fits && allow_wrapping;
+    if(fits || allow_wrapping){
+        std::vector<u32> table;
+        computeIntegralAuto(img, w, h, table);
+        r.table = std::move(table);
+    }else{
+        std::vector<u64> table;
+        computeIntegralAuto(img, w, h, table);
+        r.table = std::move(table);
+    }
+    return r;
 }
 
 #ifdef _OPENMP
 #include <omp.h>
-void computeIntegralOpenMP(const std::vector<u32>& img, std::size_t w, std::size_t h, std::vector<u64>& integral, int num_threads) noexcept{
-    if(w==0 || h==0) { integral.clear(); return; }
+template<class Pixel, class Acc>
+void computeIntegralOpenMP(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept{
+    const size_t w = img.width, h = img.height;
+    if(w==0 || h==0) return;
     if(num_threads < 1) num_threads = 1;
-    integral.assign(w*h, 0);
-    vector<u64> rowCum(w*h);
+
+    size_t rows_per = (h + num_threads - 1) / num_threads;
+    std::ptrdiff_t bands = static_cast<std::ptrdiff_t>((h + rows_per - 1) / rows_per);
+    BufferPtr<Acc> scratch = callScratch<Acc>(w, h, static_cast<size_t>(num_threads));
+    if(!scratch) { computeIntegralSingle(img, integral); return; }
+    Acc* colSum = scratch.get();
+    Acc* tops = colSum + (bands-1)*w;
+    Acc* carry = tops + (bands-1)*w;
+    Acc* rowCarry = carry + w;
 
     omp_set_num_threads(num_threads);
 #pragma omp parallel for schedule(static)
-    for(std::ptrdiff_t y=0;y<static_cast<std::ptrdiff_t>(h);++y){
-        u64 s = 0;
-        size_t base = static_cast<size_t>(y)*w;
-        for(size_t x=0;x<w;++x){
-            s += img[base + x];
-            rowCum[base + x] = s;
-        }
+    for(std::ptrdiff_t b=0;b<bands-1;++b){
+        size_t y0 = static_cast<size_t>(b)*rows_per;
+        bandColumnSums(img, y0, y0 + rows_per, colSum + static_cast<size_t>(b)*w);
     }
 
+    bandTopRows(colSum, w, static_cast<size_t>(bands), tops, carry);
+
 #pragma omp parallel for schedule(static)
-    for(std::ptrdiff_t x=0;x<static_cast<std::ptrdiff_t>(w);++x){
-        u64 s = 0;
-        for(size_t y=0;y<h;++y){
-            s += rowCum[y*w + static_cast<size_t>(x)];
-            integral[y*w + static_cast<size_t>(x)] = s;
-        }
+    for(std::ptrdiff_t b=0;b<bands;++b){
+        size_t y0 = static_cast<size_t>(b)*rows_per;
+        size_t y1 = std::min(h, y0 + rows_per);
+        integralBand<Pixel, Acc>(img, y0, y1, b ? tops + static_cast<size_t>(b-1)*w : nullptr, integral, rowCarry + y0);
     }
 }
+
+template<class Pixel, class Acc>
+void computeIntegralOpenMP(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept{
+    if(w==0 || h==0) { integral.clear(); return; }
+    integral.resize(w*h);
+    computeIntegralOpenMP(ImageView<Pixel>(img, w, h), MutableImageView<Acc>(integral, w, h), num_threads);
+}
 #endif
 
-void computeIntegralNaive(const std::vector<u32>& img, std::size_t w, std::size_t h, std::vector<u64>& integral) noexcept{
+template<class Pixel, class Acc>
+void computeIntegralNaive(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral) noexcept{
     if(w==0 || h==0) { integral.clear(); return; }
     integral.assign(w*h, 0);
     for(size_t y=0;y<h;++y){
         for(size_t x=0;x<w;++x){
-            u64 s = 0;
-            for(size_t i=0;i<=x;++i) for(size_t j=0;j<=y;++j) s += img[j*w + i];
+            Acc s = 0;
+            for(size_t i=0;i<=x;++i) for(size_t j=0;j<=y;++j) s += static_cast<Acc>(img[j*w + i]);
             integral[y*w + x] = s;
         }
     }
 }
 
+#ifdef _OPENMP
+#define INTEGRAL_INSTANTIATE_OPENMP(Pixel, Acc) \
+    template void computeIntegralOpenMP<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>, int) noexcept; \
+    template void computeIntegralOpenMP<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, int) noexcept;
+#else
+#define INTEGRAL_INSTANTIATE_OPENMP(Pixel, Acc)
+#endif
+
+#define INTEGRAL_INSTANTIATE(Pixel, Acc) \
+    template ImageView<Acc> IntegralEngine::compute<Pixel, Acc>(ImageView<Pixel>, IntegralWorkspace<Acc>&, int) noexcept; \
+    template ImageView<Acc> IntegralEngine::computeStrips<Pixel, Acc>(ImageView<Pixel>, IntegralWorkspace<Acc>&, int) noexcept; \
+    template ImageView<Acc> computeIntegralSingle<Pixel, Acc>(ImageView<Pixel>, IntegralWorkspace<Acc>&) noexcept; \
+    template ImageView<Acc> computeIntegralMulti<Pixel, Acc>(ImageView<Pixel>, IntegralWorkspace<Acc>&, int) noexcept; \
+    template void IntegralEngine::compute<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>, int) noexcept; \
+    template void IntegralEngine::computeStrips<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>, int) noexcept; \
+    template void computeIntegralSingle<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>) noexcept; \
+    template void computeIntegralMulti<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>, int) noexcept; \
+    template void computeIntegralStrips<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>, int) noexcept; \
+    template void IntegralEngine::compute<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, int) noexcept; \
+    template void IntegralEngine::computeStrips<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, int) noexcept; \
+    template void computeIntegralSingle<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&) noexcept; \
+    template void computeIntegralMulti<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, int) noexcept; \
+    template void computeIntegralStrips<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, int) noexcept; \
+    template void computeIntegralNaive<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&) noexcept; \
+    template void IntegralEngine::computeLookBack<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>, int) noexcept; \
+    template void IntegralEngine::computeLookBack<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, int) noexcept; \
+    template void computeIntegralLookBack<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>, int) noexcept; \
+    template ImageView<Acc> IntegralEngine::computeLookBack<Pixel, Acc>(ImageView<Pixel>, IntegralWorkspace<Acc>&, int) noexcept; \
+    template ImageView<Acc> computeIntegralLookBack<Pixel, Acc>(ImageView<Pixel>, IntegralWorkspace<Acc>&, int) noexcept; \
+    template void computeIntegralLookBack<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, int) noexcept; \
+    template void IntegralEngine::computeBatch<Pixel, Acc>(const ImageView<Pixel>*, const MutableImageView<Acc>*, std::size_t, int) noexcept; \
+    template void computeIntegralBatch<Pixel, Acc>(const ImageView<Pixel>*, const MutableImageView<Acc>*, std::size_t, int) noexcept; \
+    template void computeIntegralBatch<Pixel, Acc>(const std::vector<ImageView<Pixel>>&, const std::vector<MutableImageView<Acc>>&, int) noexcept; \
+    template void computeIntegralPadded<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>) noexcept; \
+    template ImageView<Acc> computeIntegralPadded<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc, IntegralAllocator<Acc>>&, std::size_t) noexcept; \
+    INTEGRAL_INSTANTIATE_OPENMP(Pixel, Acc)
+INTEGRAL_INSTANTIATE(u8, u32)
+INTEGRAL_INSTANTIATE(u16, u32)
+INTEGRAL_INSTANTIATE(u32, u32)
+INTEGRAL_INSTANTIATE(u8, u64)
+INTEGRAL_INSTANTIATE(u16, u64)
+INTEGRAL_INSTANTIATE(u32, u64)
+INTEGRAL_INSTANTIATE(float, double)
+
+template NarrowIntegral computeIntegralNarrow<u8>(const std::vector<u8>&, std::size_t, std::size_t, unsigned, bool) noexcept;
+template NarrowIntegral computeIntegralNarrow<u16>(const std::vector<u16>&, std::size_t, std::size_t, unsigned, bool) noexcept;
+template NarrowIntegral computeIntegralNarrow<u32>(const std::vector<u32>&, std::size_t, std::size_t, unsigned, bool) noexcept;
+
+template void IntegralEngine::firstTouch<u32>(MutableImageView<u32>, int) noexcept;
+template void IntegralEngine::firstTouch<u64>(MutableImageView<u64>, int) noexcept;
+template void IntegralEngine::firstTouch<double>(MutableImageView<double>, int) noexcept;
+
+#define INTEGRAL_INSTANTIATE_SQUARED(Pixel, Acc, Sq) \
+    template void IntegralEngine::computeSquared<Pixel, Acc, Sq>(ImageView<Pixel>, MutableImageView<Acc>, MutableImageView<Sq>, int) noexcept; \
+    template void IntegralEngine::computeSquared<Pixel, Acc, Sq>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, std::vector<Sq>&, int) noexcept; \
+    template void computeIntegralSquared<Pixel, Acc, Sq>(ImageView<Pixel>, MutableImageView<Acc>, MutableImageView<Sq>, int) noexcept; \
+    template void computeIntegralSquared<Pixel, Acc, Sq>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, std::vector<Sq>&, int) noexcept;
+INTEGRAL_INSTANTIATE_SQUARED(u8, u32, u64)
+INTEGRAL_INSTANTIATE_SQUARED(u8, u64, u64)
+INTEGRAL_INSTANTIATE_SQUARED(u16, u64, u64)
+INTEGRAL_INSTANTIATE_SQUARED(float, double, double)
+
 // Helper: generate random image with deterministic seed
 static void randImage(vector<u32>& img, std::size_t w, std::size_t h, uint32_t seed=1337u){
     std::mt19937 rng(seed);
@@ -160,7 +823,10 @@ int main(int argc, char**argv){
     int threads = static_cast<int>(std::thread::hardware_concurrency());
     int runs = 5;
     uint32_t seed = 1337u;
-    std::string method = "both"; // single|multi|both|openmp
+    std::string method = "both"; // single|multi|both|strips|lookback|auto|squared|tilted|rects|box|threshold|histogram|update|stream|outofcore|rgb|batch|numa|hugepages|openmp
+    std::string calibrate;     // write measured auto-tuning to this file
+    std::string input;         // PGM / PPM image to use instead of a random one
+    std::string output;        // write the integral of the image to this mapped file
 
     // Simple CLI parsing
     for(int i=1;i<argc;++i){
@@ -171,17 +837,40 @@ int main(int argc, char**argv){
         else if(s=="--runs" && i+1<argc) runs = std::stoi(argv[++i]);
         else if(s=="--seed" && i+1<argc) seed = static_cast<uint32_t>(std::stoul(argv[++i]));
         else if(s=="--method" && i+1<argc) method = argv[++i];
-        else if(s=="--help"){ cerr<<"Usage: integral [--width W] [--height H] [--threads N] [--runs R] [--seed S] [--method single|multi|both|openmp]\n"; return 0; }
+        else if(s=="--calibrate" && i+1<argc) calibrate = argv[++i];
+        else if(s=="--input" && i+1<argc) input = argv[++i];
+        else if(s=="--output" && i+1<argc) output = argv[++i];
+        else if(s=="--help"){ cerr<<"Usage: integral [--width W] [--height H] [--threads N] [--runs R] [--seed S] [--method single|multi|both|strips|lookback|auto|squared|tilted|rects|box|threshold|histogram|update|stream|outofcore|rgb|batch|numa|hugepages|openmp] [--calibrate FILE] [--input PGM/PPM] [--output FILE]\n"; return 0; }
+    }
+
+    if(!calibrate.empty()){
+        IntegralTuning t = calibrateIntegralTuning();
+        if(!saveIntegralTuning(calibrate, t)){
+            cerr << "ERROR: cannot write " << calibrate << "\n";
+            return 1;
+        }
+        cerr << "Calibrated: parallel_min_pixels="<< t.parallel_min_pixels <<"  pixels_per_thread="<< t.pixels_per_thread <<"  min_band_rows="<< t.min_band_rows <<"  -> "<< calibrate <<"\n";
+    }
+
+    // A PPM is used as its interleaved sample plane (3*w samples per row), except by --method rgb
+    MappedImage mapped;
+    vector<u32> img;
+    if(!input.empty()){
+        if(!mapped.openPnm(input) || !mapped.copyTo(img)){
+            cerr << "ERROR: cannot read " << input << " (binary PGM / PPM expected)\n";
+            return 1;
+        }
+        w = mapped.width()*mapped.channels();
+        h = mapped.height();
     }
 
     if(w==0 || h==0) throw std::invalid_argument("width and height must be > 0");
     if(runs <= 0) runs = 1;
     if(threads<=0) threads = 1;
 
-    cerr << "Image: "<< w <<" x "<< h <<"  threads="<<threads<<"  runs="<<runs<<"  seed="<<seed<<"\n";
+    cerr << "Image: "<< w <<" x "<< h <<"  threads="<<threads<<"  runs="<<runs<<"  seed="<<seed<<"  simd="<<simdLevelName(simdLevel())<<"\n";
 
-    vector<u32> img;
-    randImage(img, w, h, seed);
+    if(input.empty()) randImage(img, w, h, seed);
 
     vector<u64> I_ref, I_single, I_multi;
 
@@ -226,6 +915,309 @@ int main(int argc, char**argv){
     if(method=="both" || method=="multi"){
         t_multi = bench("Multi", [&]{ computeIntegralMulti(img,w,h,I_multi, threads); });
     }
+    if(method=="auto"){
+        computeIntegralAuto(img,w,h,I_multi);
+        if(!equalIntegral(I_single, I_multi)){
+            cerr << "ERROR: single and auto implementations differ!\n";
+            return 2;
+        }
+        IntegralPlan plan = planIntegral(w,h);
+        static const char* names[] = {"single", "bands", "strips"};
+        cerr << "Auto plan: " << names[static_cast<int>(plan.method)] << " threads=" << plan.threads << "\n";
+        bench("Auto", [&]{ computeIntegralAuto(img,w,h,I_multi); });
+    }
+    if(method=="strips"){
+        computeIntegralStrips(img,w,h,I_multi, threads);
+        if(!equalIntegral(I_single, I_multi)){
+            cerr << "ERROR: single and strips implementations differ!\n";
+            return 2;
+        }
+        bench("Strips", [&]{ computeIntegralStrips(img,w,h,I_multi, threads); });
+    }
+    if(method=="lookback"){
+        computeIntegralLookBack(img,w,h,I_multi, threads);
+        if(!equalIntegral(I_single, I_multi)){
+            cerr << "ERROR: single and look-back implementations differ!\n";
+            return 2;
+        }
+        IntegralWorkspace<u64> ws;
+        computeIntegralLookBack(ImageView<u32>(img, w, h), ws, threads);
+        bench("Look-back", [&]{ computeIntegralLookBack(img,w,h,I_multi, threads); });
+        bench("Look-back (workspace)", [&]{ computeIntegralLookBack(ImageView<u32>(img, w, h), ws, threads); });
+        bench("Multi (two-phase)", [&]{ computeIntegralMulti(img,w,h,I_multi, threads); });
+    }
+    if(method=="squared"){
+        // 8-bit copy of the test image; fused tables against two single passes over a squared copy
+        vector<u8> img8(img.begin(), img.end());
+        vector<u32> S, S_ref;
+        vector<u64> Q, Q_ref;
+        computeIntegralSquared(img8,w,h,S,Q, threads);
+        computeIntegralSingle(img8,w,h,S_ref);
+        vector<u16> sq8(w*h);
+        for(size_t i=0;i<w*h;++i) sq8[i] = static_cast<u16>(img8[i]*img8[i]);
+        computeIntegralSingle(sq8,w,h,Q_ref);
+        if(S != S_ref || Q != Q_ref){
+            cerr << "ERROR: fused and two-pass squared integrals differ!\n";
+            return 2;
+        }
+        bench("Squared (two pass)", [&]{
+            for(size_t i=0;i<w*h;++i) sq8[i] = static_cast<u16>(img8[i]*img8[i]);
+            computeIntegralSingle(img8,w,h,S_ref);
+            computeIntegralSingle(sq8,w,h,Q_ref);
+        });
+        bench("Squared (fused)", [&]{ computeIntegralSquared(img8,w,h,S,Q, threads); });
+    }
+    if(method=="tilted"){
+        vector<u64> T1, T;
+        computeTiltedIntegral(img,w,h,T1);
+        computeTiltedIntegral(img,w,h,T, threads);
+        if(T1 != T){
+            cerr << "ERROR: single and multi tilted integrals differ!\n";
+            return 2;
+        }
+        bench("Tilted (single)", [&]{ computeTiltedIntegral(img,w,h,T1); });
+        bench("Tilted (multi)", [&]{ computeTiltedIntegral(img,w,h,T, threads); });
+    }
+    if(method=="rects"){
+        // 4M random rectangles: batched gathers against one integralRectSum call per rectangle
+        const size_t n = size_t(1) << 22;
+        std::mt19937 rng(seed);
+        vector<u32> x0(n), y0(n), x1(n), y1(n);
+        for(size_t i=0;i<n;++i){
+            x0[i] = rng()%w; x1[i] = rng()%w; y0[i] = rng()%h; y1[i] = rng()%h;
+            if(x0[i]>x1[i]) std::swap(x0[i],x1[i]);
+            if(y0[i]>y1[i]) std::swap(y0[i],y1[i]);
+        }
+        RectQuery q{x0.data(), y0.data(), x1.data(), y1.data(), n};
+        vector<u64> sums, ref(n);
+        computeRectSums(I_single,w,h,q,sums, threads);
+        for(size_t i=0;i<n;++i) ref[i] = integralRectSum(I_single,w,x0[i],y0[i],x1[i],y1[i]);
+        if(sums != ref){
+            cerr << "ERROR: batched and single rectangle sums differ!\n";
+            return 2;
+        }
+        bench("Rects (one by one)", [&]{ for(size_t i=0;i<n;++i) ref[i] = integralRectSum(I_single,w,x0[i],y0[i],x1[i],y1[i]); });
+        bench("Rects (batched)", [&]{ computeRectSums(I_single,w,h,q,sums, threads); });
+        vector<u64, IntegralAllocator<u64>> P;
+        ImageView<u64> pv = computeIntegralPadded(img,w,h,P, 64);
+        bench("Rects (batched, zero-padded)", [&]{ computeRectSums(pv,q,sums.data(), threads, IntegralLayout::ZeroPadded); });
+        if(sums != ref){
+            cerr << "ERROR: zero-padded and inclusive rectangle sums differ!\n";
+            return 2;
+        }
+    }
+    if(method=="box"){
+        // radius-7 mean filter of the 8-bit image: fused filter against table + per-pixel queries
+        const size_t r = 7;
+        vector<u8> img8(img.begin(), img.end()), out(w*h), out2;
+        vector<u32> I8;
+        bench("Box (table + queries)", [&]{
+            computeIntegralMulti(img8,w,h,I8, threads);
+            for(size_t y=0;y<h;++y) for(size_t x=0;x<w;++x){
+                size_t x0 = x>r ? x-r : 0, y0 = y>r ? y-r : 0, x1 = std::min(w-1, x+r), y1 = std::min(h-1, y+r);
+                double n = static_cast<double>((x1-x0+1)*(y1-y0+1));
+                out[y*w + x] = static_cast<u8>(integralRectSum(I8,w,x0,y0,x1,y1) / n + 0.5);
+            }
+        });
+        bench("Box (fused)", [&]{ boxFilter(img8,w,h,r,out2, threads); });
+    }
+    if(method=="threshold"){
+        // Sauvola binarisation of the 8-bit image: fused stage against sum/squared tables + per-pixel rule
+        ThresholdParams p;
+        const size_t r = p.radius;
+        vector<u8> img8(img.begin(), img.end()), mask(w*h), mask2;
+        vector<u32> S;
+        vector<u64> Q;
+        bench("Threshold (tables + queries)", [&]{
+            computeIntegralSquared(img8,w,h,S,Q, threads);
+            for(size_t y=0;y<h;++y) for(size_t x=0;x<w;++x){
+                size_t x0 = x>r ? x-r : 0, y0 = y>r ? y-r : 0, x1 = std::min(w-1, x+r), y1 = std::min(h-1, y+r);
+                double n = static_cast<double>((x1-x0+1)*(y1-y0+1));
+                double mean = integralRectSum(S,w,x0,y0,x1,y1) / n;
+                double sd = std::sqrt(std::max(integralRectSum(Q,w,x0,y0,x1,y1) / n - mean*mean, 0.0));
+                mask[y*w + x] = img8[y*w + x] > mean*(1.0 + p.k*(sd/p.R - 1.0)) ? 255 : 0;
+            }
+        });
+        bench("Threshold (fused)", [&]{ adaptiveThreshold(img8,w,h,mask2,p, threads); });
+        if(mask != mask2){
+            cerr << "ERROR: fused and table-based thresholds differ!\n";
+            return 2;
+        }
+    }
+    if(!output.empty()){
+        MappedIntegral out;
+        if(!out.create<u64>(output, w, h)){
+            cerr << "ERROR: cannot create " << output << "\n";
+            return 1;
+        }
+        computeIntegralAuto(ImageView<u32>(img, w, h), out.table<u64>());
+        out.sync();
+        cerr << "Wrote "<< w <<" x "<< h <<" u64 integral to "<< output <<"\n";
+    }
+    if(method=="histogram"){
+        // 32-bin integral histogram of the 8-bit image, then 1M random 32x32 region histograms
+        const unsigned bins = 32;
+        vector<u8> img8(img.begin(), img.end());
+        IntegralHistogram H1, H;
+        H1.compute(img8,w,h,bins);
+        H.compute(img8,w,h,bins, threads);
+        bench("Histogram (single)", [&]{ H1.compute(img8,w,h,bins); });
+        bench("Histogram (multi)", [&]{ H.compute(img8,w,h,bins, threads); });
+        std::mt19937 rng(seed);
+        vector<u32> hist(bins), hist1(bins);
+        for(int i=0;i<1000;++i){
+            size_t x0 = rng()%w, y0 = rng()%h, x1 = rng()%w, y1 = rng()%h;
+            if(x0>x1) std::swap(x0,x1);
+            if(y0>y1) std::swap(y0,y1);
+            H1.query(x0,y0,x1,y1,hist1.data());
+            H.query(x0,y0,x1,y1,hist.data());
+            if(hist != hist1){
+                cerr << "ERROR: single and multi integral histograms differ!\n";
+                return 2;
+            }
+        }
+        if(w>=32 && h>=32){
+            bench("Histogram queries (1M)", [&]{
+                for(int i=0;i<(1<<20);++i){
+                    size_t x0 = rng()%(w-31), y0 = rng()%(h-31);
+                    H.query(x0,y0,x0+31,y0+31,hist.data());
+                }
+            });
+        }
+    }
+    if(method=="update"){
+        // a 64x64 block changes near the centre of each frame: dirty-rectangle update against a full recompute
+        vector<u32> next = img;
+        ImageRect d{w/2, h/2, w/2 + 63, h/2 + 63};
+        for(size_t y=d.y0;y<std::min(h, d.y1+1);++y) for(size_t x=d.x0;x<std::min(w, d.x1+1);++x) next[y*w + x] ^= 0x5a;
+        vector<u64> U = I_single, R;
+        updateIntegral(next,img,w,h,d,U, threads);
+        computeIntegralMulti(next,w,h,R, threads);
+        if(U != R){
+            cerr << "ERROR: updated and recomputed integrals differ!\n";
+            return 2;
+        }
+        bench("Update (full recompute)", [&]{ computeIntegralMulti(next,w,h,R, threads); });
+        bench("Update (dirty rectangle, there and back)", [&]{ updateIntegral(next,img,w,h,d,U, threads); updateIntegral(img,next,w,h,d,U, threads); });
+    }
+    if(method=="stream"){
+        // the image as a row stream: radius-7 box rows from a 15-row window, against the whole-image filter
+        const size_t r = 7;
+        vector<u8> img8(img.begin(), img.end()), out(w*h), ref;
+        StreamingIntegral<u8, u32> s(w, 2*r + 1);
+        bench("Stream (push + box row)", [&]{
+            s.reset();
+            for(size_t y=0;y<h;++y){
+                s.push(img8.data() + y*w);
+                s.boxFilterRow(r, out.data() + (y >= r ? (y - r)*w : 0));
+            }
+        });
+        bench("Box (whole image)", [&]{ boxFilter(img8,w,h,r,ref, threads); });
+        if(h > r && !std::equal(out.begin(), out.begin() + (h - r)*w, ref.begin())){
+            cerr << "ERROR: streamed and whole-image box filters differ!\n";
+            return 2;
+        }
+    }
+    if(method=="outofcore"){
+        // the image as a raw file in /tmp, integrated strip by strip into a second file
+        const std::string in = "/tmp/integral_bench.raw", out = "/tmp/integral_bench.sat";
+        std::ofstream(in, std::ios::binary).write(reinterpret_cast<const char*>(img.data()), static_cast<std::streamsize>(img.size()*sizeof(u32)));
+        OutOfCoreOptions o;
+        o.memoryBudget = std::size_t(16) << 20;
+        bool ok = true;
+        bench("Out-of-core (16 MB strips)", [&]{ ok = computeIntegralFile<u32, u64>(in, out, w, h, o) && ok; });
+        vector<u64> T(w*h);
+        std::ifstream(out, std::ios::binary).read(reinterpret_cast<char*>(T.data()), static_cast<std::streamsize>(T.size()*sizeof(u64)));
+        std::remove(in.c_str());
+        std::remove(out.c_str());
+        if(!ok || T != I_single){
+            cerr << "ERROR: out-of-core and in-memory integrals differ!\n";
+            return 2;
+        }
+    }
+    if(method=="rgb"){
+        // interleaved RGB (the PPM given with --input, else random): split + three single-channel
+        // integrals against the one-pass interleaved and planar kernels
+        const size_t pw = (mapped.isOpen() && mapped.channels()==3) ? mapped.width() : w;
+        vector<u8> rgb(pw*h*3);
+        if(pw != w) for(size_t i=0;i<rgb.size();++i) rgb[i] = static_cast<u8>(img[i]);
+        else{
+            // independent random samples in all three channels
+            std::mt19937 rng(seed);
+            for(auto &v: rgb) v = static_cast<u8>(rng());
+        }
+        vector<u8> plane(pw*h);
+        vector<u32> split[3], inter(3*pw*h), planes(3*pw*h);
+        bench("RGB (split + 3 x single)", [&]{
+            for(size_t k=0;k<3;++k){
+                for(size_t i=0;i<pw*h;++i) plane[i] = rgb[i*3 + k];
+                computeIntegralSingle(plane,pw,h,split[k]);
+            }
+        });
+        bench("RGB (interleaved)", [&]{ computeIntegralInterleaved(ImageView<u8>(rgb, 3*pw, h), 3, MutableImageView<u32>(inter, 3*pw, h)); });
+        MutableImageView<u32> views[3] = {{planes.data(), pw, h}, {planes.data() + pw*h, pw, h}, {planes.data() + 2*pw*h, pw, h}};
+        bench("RGB (planar)", [&]{ computeIntegralPlanar(ImageView<u8>(rgb, 3*pw, h), 3, views); });
+        for(size_t k=0;k<3;++k) for(size_t i=0;i<pw*h;++i){
+            if(inter[i*3 + k] != split[k][i] || planes[k*pw*h + i] != split[k][i]){
+                cerr << "ERROR: multi-channel and split integrals differ!\n";
+                return 2;
+            }
+        }
+    }
+    if(method=="hugepages"){
+        // same band engine into 4 KiB-page and huge-page workspaces
+        IntegralWorkspace<u64> ws_small(w, h, threads), ws_huge(w, h, threads, BufferPages::Huge);
+        ImageView<u32> view(img, w, h);
+        computeIntegralMulti(view, ws_small, threads); // fault in both tables before timing
+        ImageView<u64> r = computeIntegralMulti(view, ws_huge, threads);
+        if(!std::equal(I_single.begin(), I_single.end(), r.data)){
+            cerr << "ERROR: single and huge-page implementations differ!\n";
+            return 2;
+        }
+        bench("Multi (default pages)", [&]{ computeIntegralMulti(view, ws_small, threads); });
+        bench("Multi (huge pages)", [&]{ computeIntegralMulti(view, ws_huge, threads); });
+    }
+    if(method=="numa"){
+        // workspace tables, so the pinned engine's rows are first written by their owners
+        IntegralEngine unpinned(threads), pinned(threads, ThreadPlacement::Numa);
+        IntegralWorkspace<u64> ws_unpinned, ws_pinned;
+        ImageView<u32> view(img, w, h);
+        size_t nodes = numaNodeCpus().size();
+        cerr << "NUMA nodes: " << nodes << "  worker CPUs:";
+        for(int t=1;t<pinned.threads();++t) cerr << " " << pinned.threadCpu(t);
+        cerr << "\n";
+        ImageView<u64> r = pinned.compute(view, ws_pinned);
+        if(!std::equal(I_single.begin(), I_single.end(), r.data)){
+            cerr << "ERROR: single and NUMA-pinned implementations differ!\n";
+            return 2;
+        }
+        bench("Multi (unpinned)", [&]{ unpinned.compute(view, ws_unpinned); });
+        bench("Multi (NUMA pinned)", [&]{ pinned.compute(view, ws_pinned); });
+    }
+    if(method=="batch"){
+        // 2000 patches of 64x64 to 256x256 cut from the image: one image at a time on all threads
+        // against whole images spread over the threads
+        const size_t n = 2000;
+        std::mt19937 rng(seed);
+        vector<ImageView<u32>> patches;
+        vector<MutableImageView<u64>> outs;
+        vector<vector<u64>> tables(n), refs(n);
+        for(size_t i=0;i<n;++i){
+            size_t pw = std::min(w, size_t(64) + rng()%193), ph = std::min(h, size_t(64) + rng()%193);
+            patches.push_back(ImageView<u32>(img, w, h).roi(rng()%(w - pw + 1), rng()%(h - ph + 1), pw, ph));
+            tables[i].resize(pw*ph);
+            refs[i].resize(pw*ph);
+            outs.emplace_back(tables[i], pw, ph);
+        }
+        bench("Batch (multi per image)", [&]{
+            for(size_t i=0;i<n;++i) computeIntegralMulti(patches[i], MutableImageView<u64>(refs[i], patches[i].width, patches[i].height), threads);
+        });
+        bench("Batch (across images)", [&]{ computeIntegralBatch(patches, outs, threads); });
+        if(tables != refs){
+            cerr << "ERROR: batch and per-image integrals differ!\n";
+            return 2;
+        }
+    }
 #ifdef _OPENMP
     if(method=="openmp"){
         bench("OpenMP", [&]{ computeIntegralOpenMP(img,w,h,I_multi, threads); });
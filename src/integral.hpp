@@ -5,13 +5,560 @@
 #ifndef INTEGRAL_HPP
 #define INTEGRAL_HPP
 
+#include <atomic>
 #include <cstdint>
 #include <cstddef>
+#include <memory>
+#include <new>
+#include <string>
+#include <variant>
 #include <vector>
 
+#include "image_view.hpp"
+
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
 using u32 = std::uint32_t;
 using u64 = std::uint64_t;
 
+// The compute functions below are templated on the input pixel type and the
+// accumulator (output) type, and explicitly instantiated for these pairs only:
+//   u8 -> u32, u16 -> u64, u32 -> u64, float -> double
+// plus u8 -> u64, u16 -> u32 and u32 -> u32, which computeIntegralNarrow picks from.
+// A u32 accumulator wraps once the image total exceeds 2^32 (e.g. more than
+// 16.8M saturated u8 pixels); see computeIntegralNarrow for when that is safe. Floating-point results may differ in the last bits
+// between methods, since they sum in different orders.
+//
+// Each function also has an overload on ImageView / MutableImageView (see
+// image_view.hpp), so input and output can be ROIs of larger frames or padded,
+// pre-allocated buffers. The output view must have the input's width and
+// height; views of zero width or height are a no-op. The view overloads that
+// take an IntegralWorkspace instead write into the workspace and return a view
+// of the table; they never allocate once the workspace has been sized, and
+// return an empty view if it cannot be grown. When a per-call scratch buffer
+// cannot be allocated, the multi-threaded view overloads fall back to the
+// single-threaded pass, which needs none. The other engines degrade the same
+// way: the tilted table, boxFilter, adaptiveThreshold and IntegralHistogram
+// run as one band, and updateIntegral recomputes the whole table; if even that
+// cannot be allocated the output is left untouched (the histogram empty), and
+// computeIntegralFile returns false. None of these throw. The std::vector
+// overloads still grow their outputs through std::vector.
+
+class ThreadPool;
+
+/**
+ * Layout of an integral table. Inclusive (what every compute* function writes):
+ * w x h, entry (x, y) is the sum over [0,x] x [0,y]. ZeroPadded: (w+1) x (h+1)
+ * with a zero first row and column, entry (x+1, y+1) equal to Inclusive (x, y),
+ * so rectangle queries never need border checks (see computeIntegralPadded).
+ */
+enum class IntegralLayout { Inclusive, ZeroPadded };
+
+/** Local threshold rule of adaptiveThreshold(). */
+enum class ThresholdMethod {
+    Bradley,  // T = mean * (1 - k)
+    Sauvola   // T = mean * (1 + k * (stddev / R - 1))
+};
+
+/** Parameters of adaptiveThreshold(); statistics are over the (2*radius+1)^2 window, clipped to the image. */
+struct ThresholdParams {
+    ThresholdMethod method = ThresholdMethod::Sauvola;
+    std::size_t radius = 15;
+    double k = 0.2;    // Sauvola sensitivity (0.2 - 0.5), or Bradley's t (0.15 in the paper)
+    double R = 128.0;  // Sauvola: dynamic range of the standard deviation (128 for u8)
+};
+
+/**
+ * Batch of rectangles for computeRectSums, in structure-of-arrays form:
+ * rectangle i is the inclusive [x0[i], x1[i]] x [y0[i], y1[i]].
+ */
+struct RectQuery {
+    const u32* x0;
+    const u32* y0;
+    const u32* x1;
+    const u32* y1;
+    std::size_t count;
+};
+
+/** Inclusive pixel rectangle [x0, x1] x [y0, y1], e.g. the changed region of a frame. */
+struct ImageRect {
+    std::size_t x0, y0, x1, y1;
+};
+
+/**
+ * Pages backing large tables. A table is summed down its columns (stride w),
+ * so with 4 KiB pages a tall table needs a new TLB entry on almost every row;
+ * one 2 MiB page covers hundreds of rows of a wide table.
+ */
+enum class BufferPages {
+    Default, // 64-byte aligned heap memory
+    Huge     // 2 MiB aligned mapping: MAP_HUGETLB, else transparent huge pages, else normal pages
+};
+
+/**
+ * Uninitialised storage, 64-byte aligned, and with BufferPages::Huge for
+ * sizes of 2 MiB or more a 2 MiB aligned anonymous mapping. Reserved huge
+ * pages (MAP_HUGETLB) are tried first; without them the mapping is advised
+ * for transparent huge pages (MADV_HUGEPAGE). Returns nullptr on failure.
+ */
+void* allocateBuffer(std::size_t bytes, BufferPages pages) noexcept;
+/** Release allocateBuffer storage; bytes and pages must match the allocation. */
+void freeBuffer(void* p, std::size_t bytes, BufferPages pages) noexcept;
+
+/** Deleter for allocateBuffer storage held by a BufferPtr. */
+struct BufferDeleter {
+    std::size_t bytes = 0;
+    BufferPages pages = BufferPages::Default;
+    void operator()(void* p) const noexcept{ freeBuffer(p, bytes, pages); }
+};
+template<class T>
+using BufferPtr = std::unique_ptr<T[], BufferDeleter>;
+
+/** n uninitialised elements of trivial type T from allocateBuffer; empty on failure. */
+template<class T>
+BufferPtr<T> makeBuffer(std::size_t n, BufferPages pages) noexcept{
+    if(n > static_cast<std::size_t>(-1) / sizeof(T)) return BufferPtr<T>();
+    BufferDeleter d{n*sizeof(T), pages};
+    return BufferPtr<T>(static_cast<T*>(allocateBuffer(d.bytes, pages)), d);
+}
+
+/**
+ * Standard allocator over allocateBuffer, for tables kept in a std::vector:
+ * std::vector<u64, IntegralAllocator<u64>> table(w*h, 0, IntegralAllocator<u64>(BufferPages::Huge))
+ * and the view overloads on table.data().
+ */
+template<class T>
+struct IntegralAllocator {
+    using value_type = T;
+    BufferPages pages = BufferPages::Default;
+
+    IntegralAllocator() noexcept = default;
+    explicit IntegralAllocator(BufferPages p) noexcept : pages(p) {}
+    template<class U>
+    IntegralAllocator(const IntegralAllocator<U>& other) noexcept : pages(other.pages) {}
+
+    T* allocate(std::size_t n){
+        void* p = allocateBuffer(n*sizeof(T), pages);
+        if(!p) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, std::size_t n) noexcept{ freeBuffer(p, n*sizeof(T), pages); }
+
+    template<class U>
+    bool operator==(const IntegralAllocator<U>& other) const noexcept{ return pages == other.pages; }
+    template<class U>
+    bool operator!=(const IntegralAllocator<U>& other) const noexcept{ return pages != other.pages; }
+};
+
+/**
+ * Caller-owned output and scratch storage for repeated integral computations.
+ *
+ * Buffers grow on demand and are never shrunk or zero-filled, so once sized
+ * for the largest frame, calls make no heap allocation and every output
+ * element is written exactly once. Both buffers come from allocateBuffer with
+ * the workspace's BufferPages. Nothing here throws: a failed allocation makes
+ * reserve() return false, and the compute overloads then return an empty view.
+ */
+template<class Acc>
+class IntegralWorkspace {
+public:
+    IntegralWorkspace() = default;
+    explicit IntegralWorkspace(BufferPages pages) : pages_(pages) {}
+    /** Sized as by reserve(); check result().data if the allocation may fail. */
+    IntegralWorkspace(std::size_t w, std::size_t h, int num_threads, BufferPages pages = BufferPages::Default) noexcept : pages_(pages) { reserve(w, h, num_threads); }
+
+    /**
+     * Make room for a w x h table computed with up to num_threads threads; allocates only when growing.
+     * @return false if the memory could not be allocated (or w*h overflows); the workspace then keeps
+     *         its previous buffers but holds no table (result() is empty).
+     */
+    bool reserve(std::size_t w, std::size_t h, int num_threads) noexcept{
+        width_ = height_ = 0;
+        if(h && w > static_cast<std::size_t>(-1) / h) return false;
+        std::size_t out = w*h, scratch = scratchSize(w, h, num_threads);
+        if(!grow(output_, outputCapacity_, out) || !grow(scratch_, scratchCapacity_, scratch)) return false;
+        width_ = w; height_ = h;
+        return true;
+    }
+
+    /**
+     * Grow the scratch to at least `entries` accumulators and `flags` status
+     * words, for engines whose scratch depends on more than w, h and the
+     * thread count (computeLookBack). Allocates only when growing.
+     */
+    bool reserveScratch(std::size_t entries, std::size_t flags) noexcept{
+        if(!grow(scratch_, scratchCapacity_, entries)) return false;
+        if(flags > flagCapacity_){
+            flags_.reset(new(std::nothrow) std::atomic<u32>[flags]);
+            flagCapacity_ = flags_ ? flags : 0;
+        }
+        return flags_ || flags == 0;
+    }
+
+    BufferPages pages() const noexcept{ return pages_; }
+
+    /** Table written by the last call (packed, width() x height()). */
+    ImageView<Acc> result() const noexcept{ return ImageView<Acc>(output_.get(), width_, height_); }
+    MutableImageView<Acc> output() noexcept{ return MutableImageView<Acc>(output_.get(), width_, height_); }
+    Acc* scratch() noexcept{ return scratch_.get(); }
+    std::atomic<u32>* flags() noexcept{ return flags_.get(); }
+    std::size_t width() const noexcept{ return width_; }
+    std::size_t height() const noexcept{ return height_; }
+
+    /**
+     * Bands (strips) per thread of the band and strip engines: finer tasks let
+     * the pool's work stealing take rows off a thread that falls behind.
+     */
+    static constexpr std::size_t kTasksPerThread = 4;
+
+    /** Upper bound on the bands or strips of a call on num_threads threads. */
+    static std::size_t maxTasks(int num_threads) noexcept{
+        return num_threads <= 1 ? 1 : static_cast<std::size_t>(num_threads)*kTasksPerThread;
+    }
+
+    /** Scratch accumulators the band and strip engines need for a w x h image on num_threads threads. */
+    static std::size_t scratchSize(std::size_t w, std::size_t h, int num_threads) noexcept{
+        return 2*(maxTasks(num_threads)-1)*(w > h ? w : h) + w + h;
+    }
+
+private:
+    bool grow(BufferPtr<Acc>& buffer, std::size_t& capacity, std::size_t n) const noexcept{
+        if(n <= capacity) return true;
+        BufferPtr<Acc> p = makeBuffer<Acc>(n, pages_);
+        if(!p) return false;
+        buffer = std::move(p);
+        capacity = n;
+        return true;
+    }
+
+    BufferPages pages_ = BufferPages::Default;
+    BufferPtr<Acc> output_;
+    BufferPtr<Acc> scratch_;
+    std::unique_ptr<std::atomic<u32>[]> flags_;
+    std::size_t outputCapacity_ = 0;
+    std::size_t scratchCapacity_ = 0;
+    std::size_t flagCapacity_ = 0;
+    std::size_t width_ = 0;
+    std::size_t height_ = 0;
+};
+
+/** Window sums of boxFilter and adaptiveThreshold: u32 for u8, u64 for u16, double for float. */
+template<class Pixel> struct BoxSum;
+template<> struct BoxSum<u8> { using type = u32; };
+template<> struct BoxSum<u16> { using type = u64; };
+template<> struct BoxSum<float> { using type = double; };
+
+/**
+ * Caller-owned scratch for repeated boxFilter / adaptiveThreshold calls: the
+ * sliding column sums of every band (and their squares for Sauvola), 4*w
+ * accumulators each. Buffers come from allocateBuffer, grow on demand and are
+ * never shrunk, so once sized for the widest frame, calls make no heap allocation.
+ */
+template<class Pixel>
+class FilterWorkspace {
+public:
+    using Sum = typename BoxSum<Pixel>::type;
+
+    FilterWorkspace() = default;
+    explicit FilterWorkspace(BufferPages pages) noexcept : pages_(pages) {}
+
+    /**
+     * Make room for `bands` bands of a w-wide image, with squared sums if `squares`.
+     * @return false if the memory could not be allocated; the previous buffers are kept.
+     */
+    bool reserve(std::size_t w, std::size_t bands, bool squares) noexcept{
+        if(bands && w > static_cast<std::size_t>(-1) / 4 / bands) return false;
+        const std::size_t n = 4*bands*w;
+        return grow(sums_, sumCapacity_, n) && (!squares || grow(squares_, squareCapacity_, n));
+    }
+
+    Sum* sums() noexcept{ return sums_.get(); }
+    u64* squares() noexcept{ return squares_.get(); }
+
+private:
+    template<class T>
+    bool grow(BufferPtr<T>& buffer, std::size_t& capacity, std::size_t n) const noexcept{
+        if(n <= capacity) return true;
+        BufferPtr<T> p = makeBuffer<T>(n, pages_);
+        if(!p) return false;
+        buffer = std::move(p);
+        capacity = n;
+        return true;
+    }
+
+    BufferPages pages_ = BufferPages::Default;
+    BufferPtr<Sum> sums_;
+    BufferPtr<u64> squares_;
+    std::size_t sumCapacity_ = 0;
+    std::size_t squareCapacity_ = 0;
+};
+
+/**
+ * Integral histogram of a u8 image: one summed-area table per bin, so the
+ * histogram of any rectangle costs O(bins) instead of O(area).
+ *
+ * The per-bin tables are stored bin-interleaved: counter b of pixel (x, y),
+ * the number of bin-b pixels in [0,x] x [0,y], is at ((y*w + x)*bins + b), so
+ * a query reads four contiguous runs of `bins` counters. Counters are u16 when
+ * the image has fewer than 2^16 pixels and u32 otherwise; with allow_wrapping,
+ * u16 is used anyway and queries stay exact (in modular arithmetic, as for
+ * NarrowIntegral) for rectangles of fewer than 2^16 pixels.
+ */
+class IntegralHistogram {
+public:
+    /**
+     * Build the tables; pixel value v falls into bin v*bins/256. If w*h*bins
+     * overflows or the tables cannot be allocated, the histogram is left
+     * empty (bins() == 0).
+     *
+     * @param bins Number of bins, 1..256 (clamped).
+     * @param allow_wrapping Use u16 counters regardless of the image size.
+     */
+    void compute(ImageView<u8> img, unsigned bins, int num_threads = 1, bool allow_wrapping = false) noexcept;
+    void compute(const std::vector<u8>& img, std::size_t w, std::size_t h, unsigned bins, int num_threads = 1, bool allow_wrapping = false) noexcept;
+
+    /** hist[b] = number of bin-b pixels in the inclusive rectangle [x0,x1] x [y0,y1], for b < bins(). */
+    void query(std::size_t x0, std::size_t y0, std::size_t x1, std::size_t y1, u32* hist) const noexcept;
+
+    unsigned bins() const noexcept{ return bins_; }
+    std::size_t width() const noexcept{ return width_; }
+    std::size_t height() const noexcept{ return height_; }
+    /** true if the counters are u32, false if u16. */
+    bool wideCounters() const noexcept{ return table_.index() == 1; }
+    /** true if u16 counters were forced by allow_wrapping on an image of 2^16 pixels or more. */
+    bool wrapping() const noexcept{ return wrapping_; }
+
+private:
+    friend class IntegralEngine;
+    std::variant<std::vector<u16>, std::vector<u32>> table_;
+    std::size_t width_ = 0;
+    std::size_t height_ = 0;
+    unsigned bins_ = 0;
+    bool wrapping_ = false;
+};
+
+/**
+ * Row-by-row integral builder for images of unbounded height, such as
+ * line-scan camera streams. Each push() writes one table row from the row
+ * above it, so latency is one row; only the last window()+1 table rows are
+ * kept, in a ring, so memory is O(width * window) however long the stream.
+ *
+ * Table entries keep growing with the stream. Unsigned accumulators wrap, and
+ * rectangle sums stay exact while the rectangle's own sum fits in Acc (as for
+ * NarrowIntegral); double tables lose precision as the running total grows.
+ * Instantiated for the same (Pixel, Acc) pairs as the compute functions.
+ */
+template<class Pixel, class Acc>
+class StreamingIntegral {
+public:
+    /** @param window Number of most recent image rows that queries can reach (>= 1). */
+    StreamingIntegral(std::size_t width, std::size_t window);
+
+    /** Append the next image row (width() pixels). */
+    void push(const Pixel* row) noexcept;
+    /** Start a new stream; keeps the buffers. */
+    void reset() noexcept{ rows_ = 0; }
+
+    std::size_t width() const noexcept{ return width_; }
+    std::size_t window() const noexcept{ return window_; }
+    /** Number of rows pushed since construction or reset(). */
+    u64 rows() const noexcept{ return rows_; }
+
+    /** Table row y, the inclusive integral up to image row y; needs rows() - window() - 1 <= y < rows(). */
+    const Acc* row(u64 y) const noexcept{ return ring_.get() + (y % (window_ + 1))*width_; }
+
+    /**
+     * Sum of the inclusive rectangle [x0,x1] x [y0,y1], y being absolute row
+     * numbers in the stream; needs rows() - window() <= y0 <= y1 < rows().
+     */
+    Acc rectSum(std::size_t x0, u64 y0, std::size_t x1, u64 y1) const noexcept;
+
+    /**
+     * Next output row of boxFilter(radius) over the stream: row rows()-1-radius,
+     * whose window is now complete. Matches boxFilter on any image of which the
+     * stream so far is the top part (windows are clipped at the top, left and
+     * right). Returns false, writing nothing, while rows() <= radius or if
+     * window() < 2*radius + 1.
+     */
+    bool boxFilterRow(std::size_t radius, Pixel* out) noexcept;
+
+private:
+    std::unique_ptr<Acc[]> ring_;
+    std::unique_ptr<Acc[]> prefix_;
+    std::size_t width_;
+    std::size_t window_;
+    u64 rows_ = 0;
+};
+
+/** Where an IntegralEngine's worker threads run. */
+enum class ThreadPlacement {
+    Unpinned, // left to the OS scheduler
+    Numa      // pinned to CPUs, grouped by NUMA node in thread order
+};
+
+/**
+ * Reusable multi-threaded integral engine owning a persistent worker pool.
+ *
+ * Threads are created once in the constructor and parked between calls, so
+ * repeated calls (e.g. one per video frame) pay no thread creation cost.
+ * Calls on one engine from several threads are serialised.
+ *
+ * With ThreadPlacement::Numa the workers are split into one contiguous group
+ * per NUMA node (see numaNodeCpus()) and each is pinned to a CPU of its node.
+ * The band engines hand thread t the t-th contiguous share of the rows, so
+ * every node owns one contiguous run of rows, and work stealing tries the
+ * neighbouring (same-node) threads first. Linux places a page on the node of
+ * the thread that first writes it. Engine scratch and IntegralWorkspace
+ * storage are allocated uninitialised, so their first writers are the threads
+ * owning the rows. The calling thread is never pinned and computes the first
+ * share, so it should run on the first node (e.g. numactl --cpunodebind=0).
+ * The std::vector overloads zero-fill a growing table on the calling thread;
+ * use a workspace, or firstTouch() on an untouched caller buffer, instead.
+ */
+class IntegralEngine {
+public:
+    /**
+     * @param num_threads Number of threads to use (>=1), including the calling thread.
+     * @param placement Whether to pin the workers to CPUs node by node.
+     */
+    explicit IntegralEngine(int num_threads, ThreadPlacement placement = ThreadPlacement::Unpinned);
+    ~IntegralEngine();
+
+    IntegralEngine(const IntegralEngine&) = delete;
+    IntegralEngine& operator=(const IntegralEngine&) = delete;
+
+    /**
+     * Shortest band (strip) the band (strip) engine splits off for finer tasks:
+     * below these sizes the serial step between the phases (one row of w, or
+     * column of h, per task) costs more than stealing the task saves.
+     * kMinBandRows is also the default IntegralTuning::min_band_rows.
+     */
+    static constexpr std::size_t kMinBandRows = 32;
+    static constexpr std::size_t kMinStripCols = 256;
+
+    /** Number of threads taking part in each call. */
+    int threads() const noexcept;
+
+    /** CPU thread t (0 = caller) is pinned to, or -1 if unpinned. */
+    int threadCpu(int t) const noexcept;
+
+    /**
+     * Zero a table from the threads that will compute its rows, so that under
+     * ThreadPlacement::Numa its pages are placed on the owning nodes. Call it
+     * once on a freshly allocated (untouched) table before the first compute;
+     * same band split as compute() with the same num_threads.
+     */
+    template<class Acc>
+    void firstTouch(MutableImageView<Acc> table, int num_threads = 0) noexcept;
+
+    /**
+     * Horizontal band engine; same result and layout as computeIntegralMulti.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Pixel, class Acc>
+    void compute(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads = 0) noexcept;
+    template<class Pixel, class Acc>
+    void compute(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads = 0) noexcept;
+    /** Workspace overload: no allocation once ws is large enough; returns the table held by ws. */
+    template<class Pixel, class Acc>
+    ImageView<Acc> compute(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads = 0) noexcept;
+
+    /**
+     * Batch engine; same result as computeIntegralBatch.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Pixel, class Acc>
+    void computeBatch(const ImageView<Pixel>* images, const MutableImageView<Acc>* integrals, std::size_t count, int num_threads = 0) noexcept;
+
+    /**
+     * Vertical strip engine; same result and layout as computeIntegralStrips.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Pixel, class Acc>
+    void computeStrips(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads = 0) noexcept;
+    template<class Pixel, class Acc>
+    void computeStrips(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads = 0) noexcept;
+    template<class Pixel, class Acc>
+    ImageView<Acc> computeStrips(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads = 0) noexcept;
+
+    /**
+     * Single-pass look-back engine; same result and layout as computeIntegralLookBack.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Pixel, class Acc>
+    void computeLookBack(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads = 0) noexcept;
+    template<class Pixel, class Acc>
+    void computeLookBack(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads = 0) noexcept;
+    template<class Pixel, class Acc>
+    ImageView<Acc> computeLookBack(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads = 0) noexcept;
+
+    /**
+     * Fused sum and squared-sum band engine; same results as computeIntegralSquared.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Pixel, class Acc, class Sq>
+    void computeSquared(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, std::vector<Sq>& squared, int num_threads = 0) noexcept;
+    template<class Pixel, class Acc, class Sq>
+    void computeSquared(ImageView<Pixel> img, MutableImageView<Acc> integral, MutableImageView<Sq> squared, int num_threads = 0) noexcept;
+
+    /**
+     * Tilted (45-degree) integral band engine; same result as computeTiltedIntegral.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Pixel, class Acc>
+    void computeTilted(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& tilted, int num_threads = 0) noexcept;
+    template<class Pixel, class Acc>
+    void computeTilted(ImageView<Pixel> img, MutableImageView<Acc> tilted, int num_threads = 0) noexcept;
+
+    /**
+     * Batched rectangle sums; same result as computeRectSums.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Acc>
+    void rectSums(ImageView<Acc> integral, const RectQuery& rects, Acc* sums, int num_threads = 0, IntegralLayout layout = IntegralLayout::Inclusive) noexcept;
+
+    /**
+     * Box filter; same result as the free boxFilter.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Pixel>
+    void boxFilter(ImageView<Pixel> img, std::size_t radius, MutableImageView<Pixel> out, int num_threads = 0) noexcept;
+    template<class Pixel>
+    bool boxFilter(ImageView<Pixel> img, std::size_t radius, MutableImageView<Pixel> out, FilterWorkspace<Pixel>& ws, int num_threads = 0) noexcept;
+
+    /**
+     * Adaptive threshold; same result as the free adaptiveThreshold.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Pixel>
+    void adaptiveThreshold(ImageView<Pixel> img, MutableImageView<u8> mask, const ThresholdParams& params, int num_threads = 0) noexcept;
+    template<class Pixel>
+    bool adaptiveThreshold(ImageView<Pixel> img, MutableImageView<u8> mask, const ThresholdParams& params, FilterWorkspace<Pixel>& ws, int num_threads = 0) noexcept;
+
+    /**
+     * Incremental table update; same result as the free updateIntegral.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    template<class Pixel, class Acc>
+    void update(ImageView<Pixel> img, ImageView<Pixel> previous, const ImageRect& dirty, MutableImageView<Acc> integral, int num_threads = 0) noexcept;
+
+    /**
+     * Integral histogram band engine; same result as IntegralHistogram::compute.
+     * @param num_threads Threads to use for this call; <1 or more than threads() means all.
+     */
+    void computeHistogram(ImageView<u8> img, unsigned bins, IntegralHistogram& hist, int num_threads = 0, bool allow_wrapping = false) noexcept;
+
+private:
+    std::unique_ptr<ThreadPool> pool_;
+    ThreadPlacement placement_;
+};
+
+/**
+ * Shared engine used by the free functions, with at least num_threads threads.
+ * The engine is replaced (never shrunk) when more threads are requested.
+ */
+std::shared_ptr<IntegralEngine> defaultIntegralEngine(int num_threads);
+
 /**
  * Compute the integral image (summed-area table) for a 2D image (single-core).
  *
@@ -19,12 +566,67 @@ using u64 = std::uint64_t;
  * @param w Width of the image (pixels).
  * @param h Height of the image (pixels).
  * @param integral Output buffer: will be resized to w*h and filled with results.
+ *
+ * The vector overloads only initialise the vector when it grows; pass the
+ * same vector (or an IntegralWorkspace) on every call to avoid reallocation.
  */
-void computeIntegralSingle(const std::vector<u32>& img, std::size_t w, std::size_t h, std::vector<u64>& integral) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralSingle(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralSingle(ImageView<Pixel> img, MutableImageView<Acc> integral) noexcept;
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralSingle(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws) noexcept;
 
 /**
  * Compute the integral image using multiple threads.
- * Strategy: per-row prefix sums in parallel, then per-column prefix sums in parallel.
+ * Strategy: the image is split into one horizontal band per thread. Each band's
+ * column sums are computed in parallel and scanned into the integral row above
+ * every band; each band is then swept in cache-sized tiles, carrying row sums
+ * across tiles, so every output element is written exactly once and no w*h
+ * intermediate buffer is allocated.
+ * Runs on a shared default IntegralEngine with num_threads threads.
+ *
+ * @param img Input image stored row-major (size == w*h).
+ * @param w Width of the image (pixels).
+ * @param h Height of the image (pixels).
+ * @param integral Output buffer: will be resized to w*h and filled with results.
+ * @param num_threads Number of threads to use (>=1).
+ */
+template<class Pixel, class Acc>
+void computeIntegralMulti(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralMulti(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept;
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralMulti(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads) noexcept;
+
+/**
+ * Compute the integral image using multiple threads over vertical column strips.
+ * Strategy: per-row sums of each strip in parallel, then every strip streams
+ * down its rows adding the previous output row with wide vector adds. Suited
+ * to short, wide images where horizontal bands would leave threads idle.
+ * Runs on a shared default IntegralEngine with num_threads threads.
+ *
+ * @param img Input image stored row-major (size == w*h).
+ * @param w Width of the image (pixels).
+ * @param h Height of the image (pixels).
+ * @param integral Output buffer: will be resized to w*h and filled with results.
+ * @param num_threads Number of threads to use (>=1).
+ */
+template<class Pixel, class Acc>
+void computeIntegralStrips(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralStrips(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept;
+
+/**
+ * Compute the integral image using multiple threads in a single pass.
+ * Strategy: decoupled look-back, as in single-pass GPU scans. The rows are cut
+ * into blocks sized to the L2 cache and handed out in order. Each block sums
+ * its columns and publishes them with an atomic status flag, then adds up its
+ * predecessors' published sums until it reaches one that already knows the
+ * column sums of everything above it. It can then write its rows straight
+ * away, while its input is still cached. There is no barrier between phases,
+ * and the image is read from memory only once.
+ * Runs on a shared default IntegralEngine with num_threads threads.
  *
  * @param img Input image stored row-major (size == w*h).
  * @param w Width of the image (pixels).
@@ -32,15 +634,495 @@ void computeIntegralSingle(const std::vector<u32>& img, std::size_t w, std::size
  * @param integral Output buffer: will be resized to w*h and filled with results.
  * @param num_threads Number of threads to use (>=1).
  */
-void computeIntegralMulti(const std::vector<u32>& img, std::size_t w, std::size_t h, std::vector<u64>& integral, int num_threads) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralLookBack(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralLookBack(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept;
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralLookBack(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws, int num_threads) noexcept;
+
+/**
+ * Integral tables of many independent images (e.g. 64x64 to 256x256 patches).
+ *
+ * Parallelises across images instead of within them: each image is one task
+ * running the single-threaded SIMD kernel. Tasks are ordered largest first
+ * and balanced by the pool's work stealing, so the big images start early
+ * and the small ones even out the finish. Same result as calling
+ * computeIntegralSingle on every image.
+ *
+ * @param images Input views; integrals[i] must have the size of images[i].
+ * @param count Number of images.
+ * @param num_threads Number of threads to use (>=1).
+ */
+template<class Pixel, class Acc>
+void computeIntegralBatch(const ImageView<Pixel>* images, const MutableImageView<Acc>* integrals, std::size_t count, int num_threads = 1) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralBatch(const std::vector<ImageView<Pixel>>& images, const std::vector<MutableImageView<Acc>>& integrals, int num_threads = 1) noexcept;
 
 #ifdef _OPENMP
-void computeIntegralOpenMP(const std::vector<u32>& img, std::size_t w, std::size_t h, std::vector<u64>& integral, int num_threads) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralOpenMP(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, int num_threads) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralOpenMP(ImageView<Pixel> img, MutableImageView<Acc> integral, int num_threads) noexcept;
 #endif
 
+/**
+ * Compute the integral image and the integral of the squared pixels in one pass.
+ * Each chunk of a row is squared into an L1-resident buffer right after it is
+ * read, so the input is traversed once and no squared copy of the image is
+ * allocated; both tables use the SIMD row kernels and the band engine of
+ * computeIntegralMulti (num_threads == 1 runs on the calling thread).
+ * Instantiated for (Pixel, Acc, Sq) = (u8, u32, u64), (u8, u64, u64),
+ * (u16, u64, u64) and (float, double, double). The u16 squared table is exact
+ * up to 2^32 pixels.
+ *
+ * @param integral Output buffer: will be resized to w*h and filled with the sums.
+ * @param squared Output buffer: will be resized to w*h and filled with the sums of squares.
+ * @param num_threads Number of threads to use (>=1).
+ */
+template<class Pixel, class Acc, class Sq>
+void computeIntegralSquared(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral, std::vector<Sq>& squared, int num_threads = 1) noexcept;
+template<class Pixel, class Acc, class Sq>
+void computeIntegralSquared(ImageView<Pixel> img, MutableImageView<Acc> integral, MutableImageView<Sq> squared, int num_threads = 1) noexcept;
+
+/**
+ * Compute the 45-degree rotated summed-area table used by tilted Haar features:
+ * T(x, y) = sum of img(x', y') over y' <= y and |x' - x| <= y - y', i.e. the
+ * upward cone with apex (x, y), clipped to the image.
+ * Strategy: T = R - L, where R and L are sums of row prefix sums along the two
+ * diagonals through (x, y); both follow one-step recurrences from the row
+ * above, so each row costs one SIMD row prefix plus three vector passes and no
+ * padded or rotated copy of the image is needed. With num_threads > 1 the rows
+ * are split into bands: each band first runs from zero state to get its own
+ * diagonal sums, these are chained serially into the state entering every
+ * band, and the bands then produce their rows in parallel. If the band scratch
+ * cannot be allocated the rows run as one band, and if even the 3*w
+ * accumulators of that fail, tilted is left untouched.
+ * Unsigned tables may wrap in R and L; T is exact whenever it fits in Acc.
+ *
+ * @param tilted Output buffer: will be resized to w*h and filled with results.
+ * @param num_threads Number of threads to use (>=1).
+ */
+template<class Pixel, class Acc>
+void computeTiltedIntegral(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& tilted, int num_threads = 1) noexcept;
+template<class Pixel, class Acc>
+void computeTiltedIntegral(ImageView<Pixel> img, MutableImageView<Acc> tilted, int num_threads = 1) noexcept;
+
+/**
+ * Mean (box) filter: each output pixel is the mean of the input pixels in the
+ * (2*radius+1) x (2*radius+1) window centred on it, clipped to the image.
+ * Strategy: the integral table is consumed as it is built and never stored.
+ * Only the window's column sums (the difference of two integral rows) are
+ * kept; they slide down one input row at a time and a SIMD row prefix turns
+ * them into window sums. Cost per pixel is constant in the radius and memory
+ * is O(w) per thread. With num_threads > 1 the rows are split into bands that
+ * each prime their column sums from the 2*radius rows around their start.
+ * Instantiated for u8 (u32 sums, radius <= 2051), u16 (u64) and float (double);
+ * integer results are rounded to nearest. out must not overlap img.
+ * If the band scratch cannot be allocated the rows run as one band, and if
+ * even that fails out is left untouched.
+ *
+ * @param out Output buffer: will be resized to w*h.
+ * @param num_threads Number of threads to use (>=1).
+ */
+template<class Pixel>
+void boxFilter(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::size_t radius, std::vector<Pixel>& out, int num_threads = 1) noexcept;
+template<class Pixel>
+void boxFilter(ImageView<Pixel> img, std::size_t radius, MutableImageView<Pixel> out, int num_threads = 1) noexcept;
+
+/**
+ * boxFilter with its scratch kept in `ws`, so repeated calls make no heap allocation.
+ * @return false (out untouched) if the scratch could not be allocated.
+ */
+template<class Pixel>
+bool boxFilter(ImageView<Pixel> img, std::size_t radius, MutableImageView<Pixel> out, FilterWorkspace<Pixel>& ws, int num_threads = 1) noexcept;
+
+/**
+ * Adaptive (local) thresholding for document binarisation: mask = 255 where a
+ * pixel is above the threshold of its window (ThresholdParams), 0 otherwise.
+ * Fuses the sum and squared-sum integrals, the window mean / standard
+ * deviation and the threshold into one pass over the image, streaming rows as
+ * boxFilter does (O(w) accumulators per thread, split into bands across
+ * num_threads); Bradley skips the squared sums. Instantiated for u8 and u16.
+ * Falls back to one band, then leaves mask untouched, as boxFilter does.
+ *
+ * @param mask Output buffer: will be resized to w*h.
+ * @param num_threads Number of threads to use (>=1).
+ */
+template<class Pixel>
+void adaptiveThreshold(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<u8>& mask, const ThresholdParams& params = ThresholdParams(), int num_threads = 1) noexcept;
+template<class Pixel>
+void adaptiveThreshold(ImageView<Pixel> img, MutableImageView<u8> mask, const ThresholdParams& params = ThresholdParams(), int num_threads = 1) noexcept;
+
+/**
+ * adaptiveThreshold with its scratch kept in `ws`, so repeated calls make no heap allocation.
+ * @return false (mask untouched) if the scratch could not be allocated.
+ */
+template<class Pixel>
+bool adaptiveThreshold(ImageView<Pixel> img, MutableImageView<u8> mask, const ThresholdParams& params, FilterWorkspace<Pixel>& ws, int num_threads = 1) noexcept;
+
+/** Algorithm chosen by planIntegral(). */
+enum class IntegralMethod { Single, Bands, Strips };
+
+/** Algorithm and thread count for one image size. */
+struct IntegralPlan {
+    IntegralMethod method;
+    int threads;
+};
+
+/**
+ * Thresholds used by planIntegral(). Defaults are derived from the L2 size in
+ * sysfs; calibrateIntegralTuning() measures them on the running host.
+ */
+struct IntegralTuning {
+    std::size_t parallel_min_pixels; // images with fewer pixels run single-threaded
+    std::size_t pixels_per_thread;   // minimum pixels handed to each thread
+    std::size_t min_band_rows;       // bands shorter than this switch to vertical strips
+};
+
+/** Per-core cache sizes in bytes read from /sys/devices/system/cpu/cpu0/cache (0 if unknown). */
+struct CacheSizes {
+    std::size_t l1d, l2, l3;
+};
+CacheSizes cacheSizes() noexcept;
+
+/**
+ * CPUs of each NUMA node (from /sys/devices/system/node), restricted to the
+ * ones this process may run on; a single node with every allowed CPU when the
+ * topology is unknown.
+ */
+std::vector<std::vector<int>> numaNodeCpus();
+
+/**
+ * Tuning in effect. On first use it is loaded from the file named by the
+ * INTEGRAL_TUNING environment variable if that exists, else derived from cacheSizes().
+ */
+IntegralTuning integralTuning() noexcept;
+void setIntegralTuning(const IntegralTuning& tuning) noexcept;
+
+/** Read / write a tuning file (key=value lines). Return false on I/O or parse errors. */
+bool loadIntegralTuning(const std::string& path, IntegralTuning& tuning);
+bool saveIntegralTuning(const std::string& path, const IntegralTuning& tuning);
+
+/**
+ * One-time microbenchmark: times the single-threaded path against the band
+ * engine on growing square images to find the crossover (parallel_min_pixels,
+ * pixels_per_thread), then bands against strips on a wide image of growing
+ * height to find min_band_rows. Installs the result with setIntegralTuning()
+ * and returns it. Takes about a second.
+ */
+IntegralTuning calibrateIntegralTuning();
+
+/** Pick algorithm and thread count for a w x h image from the current tuning and core count. */
+IntegralPlan planIntegral(std::size_t w, std::size_t h) noexcept;
+
+/**
+ * Compute the integral image with the algorithm chosen by planIntegral().
+ * Same result and layout as computeIntegralSingle.
+ */
+template<class Pixel, class Acc>
+void computeIntegralAuto(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralAuto(ImageView<Pixel> img, MutableImageView<Acc> integral) noexcept;
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralAuto(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws) noexcept;
+
+/**
+ * Largest value any entry of the integral table can take: w*h*(2^bits - 1),
+ * saturated at 2^64-1.
+ */
+u64 integralMaxSum(std::size_t w, std::size_t h, unsigned bits) noexcept;
+
+/** Integral table in the narrowest safe accumulator, as chosen by computeIntegralNarrow(). */
+struct NarrowIntegral {
+    std::variant<std::vector<u32>, std::vector<u64>> table;
+    /**
+     * true if the u32 table may have wrapped. Entries are then exact modulo 2^32,
+     * and integralRectSum() in u32 arithmetic is still exact for every rectangle
+     * whose true sum is below 2^32 (any rectangle of at most 2^32 / (2^bits - 1)
+     * pixels), since the wraps cancel in A - B - C + D.
+     */
+    bool wrapping;
+};
+
+/**
+ * Compute the integral image into the narrowest safe output type.
+ * Picks u32 when integralMaxSum(w, h, bits) fits, otherwise u64 — or, with
+ * allow_wrapping, u32 anyway with modular rectangle arithmetic (see NarrowIntegral).
+ * Halves output memory and write bandwidth whenever u32 is chosen.
+ *
+ * @param img Input image stored row-major (size == w*h); Pixel is u8, u16 or u32.
+ * @param bits Significant bits per pixel (e.g. 10 or 12 for u16 containers); 0 means all bits of Pixel.
+ * @param allow_wrapping Accept a wrapping u32 table when the exact maximum does not fit.
+ */
+template<class Pixel>
+NarrowIntegral computeIntegralNarrow(const std::vector<Pixel>& img, std::size_t w, std::size_t h, unsigned bits = 0, bool allow_wrapping = false) noexcept;
+
+/**
+ * Bring the integral table of `previous` up to date for `img`, when the two
+ * frames differ only inside `dirty`.
+ *
+ * The change, integrated over the dirty rectangle, is added to the entries at
+ * or below and right of its top-left corner; every other entry is untouched.
+ * Below the rectangle the added row is the same for every row, so that part
+ * is a parallel, vectorised row add. When that lower-right region covers more
+ * than half the table, or the update's scratch cannot be allocated, the whole
+ * table is recomputed from img instead.
+ *
+ * Unsigned tables stay exact (the change wraps and cancels); float tables
+ * accumulate rounding like any other summation order.
+ *
+ * @param img New frame.
+ * @param previous Frame the table was computed from (same size as img); only its dirty rectangle is read.
+ * @param dirty Region where the frames may differ; clipped to the image.
+ * @param integral Inclusive table of `previous`, updated in place.
+ */
+template<class Pixel, class Acc>
+void updateIntegral(const std::vector<Pixel>& img, const std::vector<Pixel>& previous, std::size_t w, std::size_t h, const ImageRect& dirty, std::vector<Acc>& integral, int num_threads = 1) noexcept;
+template<class Pixel, class Acc>
+void updateIntegral(ImageView<Pixel> img, ImageView<Pixel> previous, const ImageRect& dirty, MutableImageView<Acc> integral, int num_threads = 1) noexcept;
+
+/** Strip sizing and file layout of computeIntegralFile(). */
+struct OutOfCoreOptions {
+    std::size_t stripRows = 0;                  // rows per strip; 0 derives it from memoryBudget
+    std::size_t memoryBudget = std::size_t(256) << 20; // bytes for the two input and two output strip buffers
+    u64 inputOffset = 0;                        // bytes before the first pixel of the input (e.g. a header)
+    u64 outputOffset = 0;                       // bytes before the first table entry of the output
+};
+
+/**
+ * Out-of-core integral for images larger than RAM: reads a raw row-major
+ * w x h image file (native byte order) in horizontal strips and writes the
+ * raw row-major table to `output`, carrying the last table row between strips.
+ *
+ * Input and output strips are double-buffered: one I/O thread reads the next
+ * strip and writes the previous one while the current strip is integrated, so
+ * disk and compute overlap. Memory use is about options.memoryBudget whatever
+ * the image size. The output file is created if needed and sized to
+ * outputOffset + w*h*sizeof(Acc); bytes before outputOffset are left as they are.
+ *
+ * @return false if a file cannot be opened, read or written, or the strip
+ *         buffers or I/O thread cannot be created; the output is then incomplete.
+ */
+template<class Pixel, class Acc>
+bool computeIntegralFile(const std::string& input, const std::string& output, std::size_t w, std::size_t h, const OutOfCoreOptions& options = OutOfCoreOptions()) noexcept;
+
+/**
+ * Integral tables of an interleaved multi-channel u8 image (RGB, RGBA, ...)
+ * in one pass over the pixels, without splitting it into planes first.
+ *
+ * img is the sample plane: w*channels samples per row, channels in 1..4.
+ * The interleaved form writes w*channels entries per row, channel k of pixel
+ * x at x*channels + k; the planar form writes channel k's w x h table to
+ * planes[k]. Results equal computeIntegralSingle on each channel.
+ */
+template<class Acc>
+void computeIntegralInterleaved(ImageView<u8> img, unsigned channels, MutableImageView<Acc> integral) noexcept;
+template<class Acc>
+void computeIntegralPlanar(ImageView<u8> img, unsigned channels, const MutableImageView<Acc>* planes) noexcept;
+
+/** Memory mapping of a whole file, unmapped on destruction; base of MappedImage and MappedIntegral. */
+class FileMapping {
+public:
+    FileMapping() = default;
+    ~FileMapping();
+    FileMapping(FileMapping&& other) noexcept;
+    FileMapping& operator=(FileMapping&& other) noexcept;
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+
+    bool isOpen() const noexcept{ return data_ != nullptr; }
+    std::size_t size() const noexcept{ return size_; }
+    void close() noexcept;
+
+protected:
+    /** Map `path` read-only, or read-write after creating / resizing it to `size` bytes. */
+    bool map(const std::string& path, bool writable, std::size_t size = 0) noexcept;
+    char* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool writable_ = false;
+};
+
+/**
+ * Read-only mapping of an image file: binary PGM (P5) / PPM (P6) with 8- or
+ * 16-bit samples, or headerless raw data. Pixels are read straight from the
+ * page cache; nothing is copied unless the byte order needs converting.
+ */
+class MappedImage : public FileMapping {
+public:
+    /** Map a P5 / P6 file; false if it cannot be mapped or is not one. */
+    bool openPnm(const std::string& path) noexcept;
+    /** Map a raw file of w x h pixels of `channels` interleaved samples, each bytesPerSample bytes in native order, after `offset` header bytes. */
+    bool openRaw(const std::string& path, std::size_t w, std::size_t h, unsigned channels, unsigned bytesPerSample, u64 offset = 0) noexcept;
+
+    std::size_t width() const noexcept{ return width_; }
+    std::size_t height() const noexcept{ return height_; }
+    unsigned channels() const noexcept{ return channels_; }
+    unsigned bytesPerSample() const noexcept{ return bytes_; }
+    /** true for 16-bit PNM samples, which are big-endian on disk. */
+    bool bigEndian() const noexcept{ return bigEndian_; }
+
+    /**
+     * Zero-copy view of the samples (width()*channels() per row), or an empty
+     * view unless sizeof(Sample) == bytesPerSample() and the samples are in
+     * native byte order. Sample is u8 or u16.
+     */
+    template<class Sample>
+    ImageView<Sample> samples() const noexcept;
+
+    /** Samples widened to Pixel in native order (u8, u16 or u32); false if Pixel is narrower than a sample. */
+    template<class Pixel>
+    bool copyTo(std::vector<Pixel>& out) const noexcept;
+
+private:
+    const char* pixels_ = nullptr;
+    std::size_t width_ = 0;
+    std::size_t height_ = 0;
+    unsigned channels_ = 0;
+    unsigned bytes_ = 0;
+    bool bigEndian_ = false;
+};
+
+/** Header at the start of a MappedIntegral file; 64 bytes, native byte order. */
+struct IntegralFileHeader {
+    char magic[8];      // "INTEGRL1"
+    u64 width;          // pixels per row
+    u64 height;         // image rows (ZeroPadded tables have one more)
+    u64 stride;         // table entries per row
+    u64 dataOffset;     // bytes from the start of the file to the first entry
+    u32 channels;       // interleaved channels per pixel, or number of planes
+    u32 accBytes;       // 4 or 8
+    u32 accFloat;       // 1 for floating-point accumulators
+    u32 layout;         // IntegralLayout
+    u32 planar;         // 1 if each channel is a separate plane
+    u32 reserved;
+};
+
+/**
+ * Integral table in a memory-mapped file with an IntegralFileHeader, so a
+ * producer can compute straight into the page cache and other processes can
+ * map the result read-only. Compute into table<Acc>() with any of the view
+ * overloads (computeIntegralPadded for the ZeroPadded layout).
+ */
+class MappedIntegral : public FileMapping {
+public:
+    /** Create or replace `path` with room for the table(s) of a w x h image and map it read-write. */
+    template<class Acc>
+    bool create(const std::string& path, std::size_t w, std::size_t h, unsigned channels = 1, IntegralLayout layout = IntegralLayout::Inclusive, bool planar = false) noexcept;
+    /** Map an existing file read-only; false if it is not a valid integral file. */
+    bool open(const std::string& path) noexcept;
+
+    const IntegralFileHeader& header() const noexcept{ return *reinterpret_cast<const IntegralFileHeader*>(data_); }
+
+    /**
+     * The table (or plane `plane` of a planar file): stride entries wide, with
+     * one extra row and column for ZeroPadded. Empty if Acc does not match the
+     * header; writable only after create().
+     */
+    template<class Acc>
+    MutableImageView<Acc> table(unsigned plane = 0) noexcept;
+    template<class Acc>
+    ImageView<Acc> view(unsigned plane = 0) const noexcept;
+
+    /** Write dirty pages back to the file (msync). */
+    bool sync() noexcept;
+};
+
+/**
+ * Sum of the pixels in the inclusive rectangle [x0,x1] x [y0,y1] of a w-wide
+ * integral table. Unsigned accumulators use modular arithmetic, so wrapped
+ * u32 tables give exact results for rectangles whose sum fits in u32.
+ */
+template<class Acc>
+inline Acc integralRectSum(const std::vector<Acc>& I, std::size_t w, std::size_t x0, std::size_t y0, std::size_t x1, std::size_t y1) noexcept{
+    Acc A = I[y1*w + x1];
+    Acc B = (y0>0) ? I[(y0-1)*w + x1] : Acc(0);
+    Acc C = (x0>0) ? I[y1*w + (x0-1)] : Acc(0);
+    Acc D = (x0>0 && y0>0) ? I[(y0-1)*w + (x0-1)] : Acc(0);
+    return A - B - C + D;
+}
+
+/**
+ * Evaluate a batch of rectangle sums from an integral table:
+ * sums[i] is the four-corner sum of integralRectSum() for rectangle i.
+ * The four corners of AVX2 / AVX-512 lane groups are fetched with gathers,
+ * with the rows above and columns left of the table masked out of the loads
+ * instead of branched on; the batch is split into chunks across num_threads.
+ * Instantiated for Acc = u32, u64 and double. Rectangles must lie inside the
+ * image, and the table's row stride must be below 2^32 elements.
+ *
+ * @param integral Table in the given layout; for ZeroPadded, the full (w+1) x (h+1)
+ *        view, and the kernels need no masks at all.
+ * @param sums Output: rects.count sums (resized by the vector overload).
+ */
+template<class Acc>
+void computeRectSums(ImageView<Acc> integral, const RectQuery& rects, Acc* sums, int num_threads = 1, IntegralLayout layout = IntegralLayout::Inclusive) noexcept;
+template<class Acc>
+void computeRectSums(const std::vector<Acc>& integral, std::size_t w, std::size_t h, const RectQuery& rects, std::vector<Acc>& sums, int num_threads = 1) noexcept;
+
+/**
+ * Row stride in bytes of a ZeroPadded table for a w-wide image: w+1 accumulators,
+ * rounded up to a multiple of `align` bytes (e.g. 64 for a cache line; a multiple
+ * of sizeof(Acc)) when align > 0.
+ */
+template<class Acc>
+constexpr std::size_t paddedIntegralStride(std::size_t w, std::size_t align = 0) noexcept{
+    std::size_t bytes = (w + 1)*sizeof(Acc);
+    return align ? (bytes + align - 1) / align * align : bytes;
+}
+
+/**
+ * Compute the integral image in the ZeroPadded layout: writes the zero first
+ * row and column, and the interior with the algorithm of computeIntegralAuto.
+ * Padding elements past column w are left untouched.
+ *
+ * @param padded (w+1) x (h+1) output view for a w x h image; any stride.
+ */
+template<class Pixel, class Acc>
+void computeIntegralPadded(ImageView<Pixel> img, MutableImageView<Acc> padded) noexcept;
+
+/**
+ * Vector form of computeIntegralPadded: `padded` is resized to (h+1) rows of
+ * paddedIntegralStride<Acc>(w, align) bytes. IntegralAllocator starts the table
+ * on a cache line, so with align = 64 every row is cache-line aligned.
+ * Returns the (w+1) x (h+1) view of the table.
+ */
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralPadded(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc, IntegralAllocator<Acc>>& padded, std::size_t align = 0) noexcept;
+
+/**
+ * Sum of the pixels in the inclusive rectangle [x0,x1] x [y0,y1] from a
+ * ZeroPadded table: four loads, no branches.
+ */
+template<class Acc>
+inline Acc paddedRectSum(ImageView<Acc> P, std::size_t x0, std::size_t y0, std::size_t x1, std::size_t y1) noexcept{
+    const Acc* top = P.row(y0);
+    const Acc* bottom = P.row(y1 + 1);
+    return bottom[x1 + 1] - top[x1 + 1] - bottom[x0] + top[x0];
+}
+
+/**
+ * Sum of a 45-degree rotated rectangle from a w-wide tilted table (computeTiltedIntegral).
+ * The rectangle has its top pixel at (x, y) and sides of rw steps down-right and
+ * rh steps down-left: it covers the pixels with x + y <= x' + y' < x + y + 2*rw
+ * and y - x <= y' - x' < y - x + 2*rh (2*rw*rh pixels, Lienhart's rotated
+ * feature). It must lie inside the image: rh <= x, x + rw <= w and y + rw + rh <= h.
+ */
+template<class Acc>
+inline Acc tiltedRectSum(const std::vector<Acc>& T, std::size_t w, std::size_t x, std::size_t y, std::size_t rw, std::size_t rh) noexcept{
+    // corner (cx, cy) may sit one row above the image or one column right of it;
+    // the cone at (w, cy) is the same set of pixels as the cone at (w-1, cy-1)
+    auto at = [&](std::size_t cx, std::size_t cy1) -> Acc {   // cy1 = cy + 1
+        if(cx == w){ --cx; if(cy1 == 0) return Acc(0); --cy1; }
+        return cy1 ? T[(cy1-1)*w + cx] : Acc(0);
+    };
+    return at(x + rw - rh, y + rw + rh) - at(x + rw, y + rw) - at(x - rh, y + rh) + at(x, y);
+}
+
 /**
  * Naive reference implementation: O(w*h*avg_area) used for small tests; not intended for benchmarks on large images.
  */
-void computeIntegralNaive(const std::vector<u32>& img, std::size_t w, std::size_t h, std::vector<u64>& integral) noexcept;
+template<class Pixel, class Acc>
+void computeIntegralNaive(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral) noexcept;
 
 #endif // INTEGRAL_HPP
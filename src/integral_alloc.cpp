@@ -0,0 +1,70 @@
+// integral_alloc.cpp
+// Aligned and huge-page backed storage for integral tables and scratch
+// (allocateBuffer / freeBuffer).
+
+#include "integral.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+using std::size_t;
+
+static constexpr size_t kCacheLine = 64;
+static constexpr size_t kHugePageSize = size_t(2) << 20;
+
+static size_t roundUp(size_t n, size_t to) noexcept{
+    return (n + to - 1) / to * to;
+}
+
+// Mapped (rather than heap) storage: huge pages requested, on Linux, for at
+// least one huge page. freeBuffer takes the same decision from the same
+// arguments.
+static bool mapped(size_t bytes, BufferPages pages) noexcept{
+#ifdef __linux__
+    return pages == BufferPages::Huge && bytes >= kHugePageSize;
+#else
+    (void)bytes;
+    (void)pages;
+    return false;
+#endif
+}
+
+void* allocateBuffer(std::size_t bytes, BufferPages pages) noexcept{
+#ifdef __linux__
+    if(mapped(bytes, pages)){
+        const size_t len = roundUp(bytes, kHugePageSize);
+        void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(p != MAP_FAILED) return p;
+
+        // No reserved huge pages: map one page more than needed, trim it to a
+        // 2 MiB boundary so whole huge pages fit, and ask for transparent ones.
+        p = mmap(nullptr, len + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p == MAP_FAILED) return nullptr;
+        const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(p);
+        const std::uintptr_t aligned = roundUp(base, kHugePageSize);
+        if(aligned > base) munmap(p, aligned - base);
+        const std::uintptr_t end = base + len + kHugePageSize;
+        if(end > aligned + len) munmap(reinterpret_cast<void*>(aligned + len), end - (aligned + len));
+        // advisory only; kernels without THP keep the normal pages
+        madvise(reinterpret_cast<void*>(aligned), len, MADV_HUGEPAGE);
+        return reinterpret_cast<void*>(aligned);
+    }
+#endif
+    return std::aligned_alloc(kCacheLine, roundUp(bytes ? bytes : 1, kCacheLine));
+}
+
+void freeBuffer(void* p, std::size_t bytes, BufferPages pages) noexcept{
+    if(!p) return;
+#ifdef __linux__
+    if(mapped(bytes, pages)){
+        munmap(p, roundUp(bytes, kHugePageSize));
+        return;
+    }
+#endif
+    std::free(p);
+}
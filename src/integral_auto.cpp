@@ -0,0 +1,285 @@
+// integral_auto.cpp
+// Size-aware strategy selection (computeIntegralAuto) and its tuning: cache
+// sizes from sysfs, a crossover microbenchmark, and a small key=value file.
+
+#include "integral.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+using std::size_t;
+using std::vector;
+
+// Parse sysfs cache sizes such as "48K", "2048K" or "32M".
+static size_t parseCacheSize(const std::string& s){
+    size_t v = 0, i = 0;
+    while(i<s.size() && s[i]>='0' && s[i]<='9') v = v*10 + static_cast<size_t>(s[i++]-'0');
+    if(i<s.size() && (s[i]=='K' || s[i]=='k')) v <<= 10;
+    else if(i<s.size() && (s[i]=='M' || s[i]=='m')) v <<= 20;
+    return v;
+}
+
+CacheSizes cacheSizes() noexcept{
+    CacheSizes c{0, 0, 0};
+    try{
+        for(int i=0;i<8;++i){
+            std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/";
+            std::ifstream flevel(dir + "level"), ftype(dir + "type"), fsize(dir + "size");
+            int level = 0;
+            std::string type, size;
+            if(!(flevel >> level) || !(ftype >> type) || !(fsize >> size)) continue;
+            if(type == "Instruction") continue;
+            size_t bytes = parseCacheSize(size);
+            if(level == 1) c.l1d = bytes;
+            else if(level == 2) c.l2 = bytes;
+            else if(level == 3) c.l3 = bytes;
+        }
+    }catch(...){
+        // sizes stay 0; callers fall back to defaults
+    }
+    return c;
+}
+
+static unsigned coreCount() noexcept{
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+// Parse a sysfs CPU list such as "0-7,16-23".
+static vector<int> parseCpuList(const std::string& s){
+    vector<int> cpus;
+    size_t i = 0;
+    auto number = [&]{
+        int v = 0;
+        while(i<s.size() && s[i]>='0' && s[i]<='9') v = v*10 + (s[i++]-'0');
+        return v;
+    };
+    while(i<s.size() && s[i]>='0' && s[i]<='9'){
+        int first = number(), last = first;
+        if(i<s.size() && s[i]=='-') { ++i; last = number(); }
+        for(int c=first;c<=last;++c) cpus.push_back(c);
+        if(i<s.size() && s[i]==',') ++i;
+    }
+    return cpus;
+}
+
+vector<vector<int>> numaNodeCpus(){
+    vector<int> allowed;
+#ifdef __linux__
+    cpu_set_t mask;
+    if(sched_getaffinity(0, sizeof(mask), &mask) == 0){
+        for(int c=0;c<CPU_SETSIZE;++c) if(CPU_ISSET(c, &mask)) allowed.push_back(c);
+    }
+#endif
+    if(allowed.empty()) for(unsigned c=0;c<coreCount();++c) allowed.push_back(static_cast<int>(c));
+
+    vector<vector<int>> nodes;
+    try{
+        for(int n=0;n<1024;++n){
+            std::ifstream f("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+            std::string list;
+            if(!(f >> list)) continue;
+            vector<int> cpus;
+            for(int c: parseCpuList(list)) if(std::binary_search(allowed.begin(), allowed.end(), c)) cpus.push_back(c);
+            if(!cpus.empty()) nodes.push_back(std::move(cpus));
+        }
+    }catch(...){
+        nodes.clear();
+    }
+    // no sysfs topology: one node holding every CPU we may run on
+    if(nodes.empty()) nodes.push_back(allowed);
+    return nodes;
+}
+
+// An image whose input and output (12 bytes/pixel) fit in L2 is done before
+// waking the pool pays off, so parallelism starts at a few times that size.
+// Bands start at the band engine's own floor, so a planned band is not re-split.
+static IntegralTuning cacheDerivedTuning() noexcept{
+    size_t l2 = cacheSizes().l2;
+    if(l2 == 0) l2 = size_t(1) << 20;
+    return IntegralTuning{l2 / 4, l2 / 8, IntegralEngine::kMinBandRows};
+}
+
+static std::mutex tuningMutex;
+static bool tuningSet = false;
+static IntegralTuning tuningValue;
+
+IntegralTuning integralTuning() noexcept{
+    std::lock_guard<std::mutex> lk(tuningMutex);
+    if(!tuningSet){
+        tuningValue = cacheDerivedTuning();
+        if(const char* path = std::getenv("INTEGRAL_TUNING")){
+            // an unreadable file (or no memory to read it) keeps the cache-derived values
+            try{
+                IntegralTuning t;
+                if(loadIntegralTuning(path, t)) tuningValue = t;
+            }catch(...){}
+        }
+        tuningSet = true;
+    }
+    return tuningValue;
+}
+
+void setIntegralTuning(const IntegralTuning& tuning) noexcept{
+    std::lock_guard<std::mutex> lk(tuningMutex);
+    tuningValue = tuning;
+    tuningSet = true;
+}
+
+bool loadIntegralTuning(const std::string& path, IntegralTuning& tuning){
+    std::ifstream in(path);
+    if(!in) return false;
+    IntegralTuning t = cacheDerivedTuning();
+    std::string line;
+    while(std::getline(in, line)){
+        if(line.empty() || line[0]=='#') continue;
+        size_t eq = line.find('=');
+        if(eq == std::string::npos) return false;
+        std::string key = line.substr(0, eq);
+        size_t value;
+        try{ value = static_cast<size_t>(std::stoull(line.substr(eq+1))); }
+        catch(...){ return false; }
+        if(key == "parallel_min_pixels") t.parallel_min_pixels = value;
+        else if(key == "pixels_per_thread") t.pixels_per_thread = std::max<size_t>(1, value);
+        else if(key == "min_band_rows") t.min_band_rows = std::max<size_t>(1, value);
+        else return false;
+    }
+    tuning = t;
+    return true;
+}
+
+bool saveIntegralTuning(const std::string& path, const IntegralTuning& tuning){
+    std::ofstream out(path);
+    if(!out) return false;
+    out << "# integral image auto-tuning (see calibrateIntegralTuning)\n"
+        << "parallel_min_pixels=" << tuning.parallel_min_pixels << "\n"
+        << "pixels_per_thread=" << tuning.pixels_per_thread << "\n"
+        << "min_band_rows=" << tuning.min_band_rows << "\n";
+    return static_cast<bool>(out);
+}
+
+// Median wall time of f over a few runs, after one warm-up run.
+template<class F>
+static double medianSeconds(F&& f, int runs){
+    vector<double> t;
+    f();
+    for(int r=0;r<runs;++r){
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        auto t1 = std::chrono::steady_clock::now();
+        t.push_back(std::chrono::duration<double>(t1 - t0).count());
+    }
+    std::nth_element(t.begin(), t.begin() + t.size()/2, t.end());
+    return t[t.size()/2];
+}
+
+IntegralTuning calibrateIntegralTuning(){
+    IntegralTuning t = cacheDerivedTuning();
+    int cores = static_cast<int>(coreCount());
+    if(cores == 1){
+        t.parallel_min_pixels = std::numeric_limits<size_t>::max();
+        setIntegralTuning(t);
+        return t;
+    }
+
+    std::shared_ptr<IntegralEngine> engine = defaultIntegralEngine(cores);
+    std::mt19937 rng(1337u);
+    vector<u32> img;
+    vector<u64> out;
+    size_t crossover = std::numeric_limits<size_t>::max();
+    for(size_t side=128; side<=4096; side*=2){
+        img.resize(side*side);
+        for(auto &v: img) v = rng() & 0xFF;
+        double single = medianSeconds([&]{ computeIntegralSingle(img, side, side, out); }, 5);
+        double multi = medianSeconds([&]{ engine->compute(img, side, side, out, cores); }, 5);
+        if(multi < 0.9 * single){ crossover = side*side; break; }
+    }
+    t.parallel_min_pixels = crossover;
+    if(crossover != std::numeric_limits<size_t>::max()) t.pixels_per_thread = std::max<size_t>(1, crossover / static_cast<size_t>(cores));
+
+    // Bands against strips on a wide image with `rows` rows per thread: the
+    // shortest band height at which bands are no slower is min_band_rows. If
+    // strips win at every measured height the tallest one is kept.
+    const size_t wide = 4096;
+    for(size_t rows=1; rows<=256 && rows*static_cast<size_t>(cores)*wide <= (size_t(1) << 24); rows*=2){
+        size_t h = rows*static_cast<size_t>(cores);
+        img.resize(wide*h);
+        for(auto &v: img) v = rng() & 0xFF;
+        double bands = medianSeconds([&]{ engine->compute(img, wide, h, out, cores); }, 5);
+        double strips = medianSeconds([&]{ engine->computeStrips(img, wide, h, out, cores); }, 5);
+        t.min_band_rows = rows;
+        if(bands <= strips) break;
+    }
+    setIntegralTuning(t);
+    return t;
+}
+
+IntegralPlan planIntegral(std::size_t w, std::size_t h) noexcept{
+    IntegralTuning t = integralTuning();
+    size_t pixels = w*h;
+    size_t cores = coreCount();
+    if(cores == 1 || pixels < t.parallel_min_pixels) return IntegralPlan{IntegralMethod::Single, 1};
+
+    size_t threads = std::min(cores, std::max<size_t>(1, pixels / t.pixels_per_thread));
+    if(threads <= 1) return IntegralPlan{IntegralMethod::Single, 1};
+    if(h / threads >= t.min_band_rows) return IntegralPlan{IntegralMethod::Bands, static_cast<int>(threads)};
+    // short, wide image: strips are at least one cache line of output wide
+    threads = std::min(threads, std::max<size_t>(1, w / 8));
+    return IntegralPlan{threads > 1 ? IntegralMethod::Strips : IntegralMethod::Single, static_cast<int>(threads)};
+}
+
+template<class Pixel, class Acc>
+void computeIntegralAuto(ImageView<Pixel> img, MutableImageView<Acc> integral) noexcept{
+    IntegralPlan plan = planIntegral(img.width, img.height);
+    switch(plan.method){
+        case IntegralMethod::Single: computeIntegralSingle(img, integral); break;
+        case IntegralMethod::Bands: computeIntegralMulti(img, integral, plan.threads); break;
+        case IntegralMethod::Strips: computeIntegralStrips(img, integral, plan.threads); break;
+    }
+}
+
+template<class Pixel, class Acc>
+ImageView<Acc> computeIntegralAuto(ImageView<Pixel> img, IntegralWorkspace<Acc>& ws) noexcept{
+    IntegralPlan plan = planIntegral(img.width, img.height);
+    switch(plan.method){
+        case IntegralMethod::Single: return computeIntegralSingle(img, ws);
+        case IntegralMethod::Bands: return computeIntegralMulti(img, ws, plan.threads);
+        case IntegralMethod::Strips: return defaultIntegralEngine(plan.threads)->computeStrips(img, ws, plan.threads);
+    }
+    return ws.result();
+}
+
+template<class Pixel, class Acc>
+void computeIntegralAuto(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& integral) noexcept{
+    IntegralPlan plan = planIntegral(w, h);
+    switch(plan.method){
+        case IntegralMethod::Single: computeIntegralSingle(img, w, h, integral); break;
+        case IntegralMethod::Bands: computeIntegralMulti(img, w, h, integral, plan.threads); break;
+        case IntegralMethod::Strips: computeIntegralStrips(img, w, h, integral, plan.threads); break;
+    }
+}
+
+#define INTEGRAL_INSTANTIATE_AUTO(Pixel, Acc) \
+    template ImageView<Acc> computeIntegralAuto<Pixel, Acc>(ImageView<Pixel>, IntegralWorkspace<Acc>&) noexcept; \
+    template void computeIntegralAuto<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>) noexcept; \
+    template void computeIntegralAuto<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&) noexcept;
+INTEGRAL_INSTANTIATE_AUTO(u8, u32)
+INTEGRAL_INSTANTIATE_AUTO(u16, u32)
+INTEGRAL_INSTANTIATE_AUTO(u32, u32)
+INTEGRAL_INSTANTIATE_AUTO(u8, u64)
+INTEGRAL_INSTANTIATE_AUTO(u16, u64)
+INTEGRAL_INSTANTIATE_AUTO(u32, u64)
+INTEGRAL_INSTANTIATE_AUTO(float, double)
@@ -0,0 +1,43 @@
+// integral_channels.cpp
+// Integral tables of interleaved multi-channel u8 images (RGB, RGBA) in one
+// pass, into one interleaved table or one plane per channel.
+
+#include "integral.hpp"
+#include "integral_kernels.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+using std::size_t;
+
+template<class Acc>
+void computeIntegralInterleaved(ImageView<u8> img, unsigned channels, MutableImageView<Acc> integral) noexcept{
+    channels = std::min(std::max(channels, 1u), 4u);
+    const size_t w = img.width / channels, h = img.height;
+    if(w==0 || h==0) return;
+    const auto interleavedRow = channelKernels<Acc>().interleavedRow;
+    for(size_t y=0;y<h;++y) interleavedRow(img.row(y), y ? integral.row(y-1) : nullptr, integral.row(y), w, channels);
+}
+
+template<class Acc>
+void computeIntegralPlanar(ImageView<u8> img, unsigned channels, const MutableImageView<Acc>* planes) noexcept{
+    channels = std::min(std::max(channels, 1u), 4u);
+    const size_t w = img.width / channels, h = img.height;
+    if(w==0 || h==0) return;
+    const auto planarRow = channelKernels<Acc>().planarRow;
+    Acc* out[4];
+    const Acc* prev[4];
+    for(size_t y=0;y<h;++y){
+        for(unsigned k=0;k<channels;++k){
+            out[k] = planes[k].row(y);
+            prev[k] = y ? planes[k].row(y-1) : nullptr;
+        }
+        planarRow(img.row(y), y ? prev : nullptr, out, w, channels);
+    }
+}
+
+#define INTEGRAL_INSTANTIATE_CHANNELS(Acc) \
+    template void computeIntegralInterleaved<Acc>(ImageView<u8>, unsigned, MutableImageView<Acc>) noexcept; \
+    template void computeIntegralPlanar<Acc>(ImageView<u8>, unsigned, const MutableImageView<Acc>*) noexcept;
+INTEGRAL_INSTANTIATE_CHANNELS(u32)
+INTEGRAL_INSTANTIATE_CHANNELS(u64)
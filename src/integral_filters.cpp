@@ -0,0 +1,223 @@
+// integral_filters.cpp
+// Filters that consume the integral image as it is produced (boxFilter,
+// adaptiveThreshold).
+//
+// Rows of the integral table are never stored: for output row y only the
+// column sums of the window rows [y-r, y+r] are kept, i.e. the difference of
+// integral rows y+r and y-r-1, and a SIMD prefix over them gives the row of
+// window sums. Moving down one row adds one input row and removes another, so
+// the cost per pixel does not depend on the radius.
+
+#include "integral.hpp"
+#include "integral_kernels.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+using std::size_t;
+
+// Pixels squared per chunk on their way into the squared column sums (stays in L1).
+static constexpr size_t kSquareChunk = 1024;
+
+// Sliding column sums of one band: `added` accumulates every row that has
+// entered the window and `removed` every row that has left it, so the window
+// column sums are added - removed (exact in wrapping unsigned arithmetic).
+// With Square, the sums are of the squared pixels.
+template<class Pixel, class Acc, bool Square = false>
+struct WindowColumns {
+    ImageView<Pixel> img;
+    size_t r;
+    Acc* added;
+    Acc* removed;
+    Acc* window;
+
+    void addRow(size_t y, Acc* acc) const noexcept{
+        const Pixel* row = img.row(y);
+        if constexpr (Square){
+            using SqPixel = typename SquaredPixel<Pixel>::type;
+            const auto columnSum = integralKernels<SqPixel, Acc>().columnSum;
+            SqPixel sq[kSquareChunk];
+            for(size_t x0=0;x0<img.width;x0+=kSquareChunk){
+                size_t n = std::min(img.width - x0, kSquareChunk);
+                squarePixels(row + x0, sq, n);
+                columnSum(sq, acc + x0, n);
+            }
+        }else{
+            integralKernels<Pixel, Acc>().columnSum(row, acc, img.width);
+        }
+    }
+
+    // Prime with the window of row y0-1 (rows [y0-r-1, y0+r)), which advance(y0) slides.
+    void start(size_t y0) noexcept{
+        const size_t w = img.width;
+        std::fill(added, added + w, Acc(0));
+        std::fill(removed, removed + w, Acc(0));
+        for(size_t y=(y0 > r ? y0 - r - 1 : 0);y<std::min(img.height, y0 + r);++y) addRow(y, added);
+    }
+
+    // Slide to output row y and return the number of image rows in its window.
+    size_t advance(size_t y) noexcept{
+        const size_t w = img.width;
+        if(y + r < img.height) addRow(y + r, added);
+        if(y > r) addRow(y - r - 1, removed);
+        for(size_t x=0;x<w;++x) window[x] = added[x] - removed[x];
+        return std::min(y + r, img.height - 1) - (y > r ? y - r : 0) + 1;
+    }
+};
+
+// Bands of at least one window height (each band re-reads the rows above it to prime its sums).
+static size_t windowBandRows(size_t h, size_t radius, int num_threads) noexcept{
+    size_t rows_per = (h + static_cast<size_t>(num_threads) - 1) / static_cast<size_t>(num_threads);
+    return std::max(rows_per, std::min(h, 2*radius + 1));
+}
+
+// Scratch for bands of rows_per rows, or else for one band (rows_per = h):
+// bands share no state, so a single band gives the same result serially.
+template<class Pixel>
+static bool reserveBands(FilterWorkspace<Pixel>& ws, size_t w, size_t h, size_t& rows_per, bool squares) noexcept{
+    if(ws.reserve(w, (h + rows_per - 1) / rows_per, squares)) return true;
+    rows_per = h;
+    return ws.reserve(w, 1, squares);
+}
+
+template<class Pixel>
+bool IntegralEngine::boxFilter(ImageView<Pixel> img, std::size_t radius, MutableImageView<Pixel> out, FilterWorkspace<Pixel>& ws, int num_threads) noexcept{
+    using Acc = typename BoxSum<Pixel>::type;
+    const size_t w = img.width, h = img.height;
+    if(w==0 || h==0) return true;
+    if(num_threads < 1 || num_threads > pool_->size()) num_threads = pool_->size();
+
+    size_t rows_per = windowBandRows(h, radius, num_threads);
+    if(!reserveBands(ws, w, h, rows_per, false)) return false;
+    size_t bands = (h + rows_per - 1) / rows_per;
+    Acc* scratch = ws.sums();
+
+    pool_->run(bands, [&](size_t b){
+        const auto boxRow = integralKernels<Pixel, Acc>().boxRow;
+        const auto prefixRow = integralKernels<Acc, Acc>().rowPrefix;
+        Acc* s = scratch + 4*b*w;
+        WindowColumns<Pixel, Acc> win{img, radius, s, s + w, s + 2*w};
+        Acc* prefix = s + 3*w;
+        size_t y0 = b*rows_per;
+        size_t y1 = std::min(h, y0 + rows_per);
+        win.start(y0);
+        for(size_t y=y0;y<y1;++y){
+            size_t rows = win.advance(y);
+            prefixRow(win.window, nullptr, prefix, w, 0);
+            boxRow(prefix, out.row(y), w, radius, rows);
+        }
+    });
+    return true;
+}
+
+template<class Pixel>
+void IntegralEngine::boxFilter(ImageView<Pixel> img, std::size_t radius, MutableImageView<Pixel> out, int num_threads) noexcept{
+    FilterWorkspace<Pixel> ws;
+    boxFilter(img, radius, out, ws, num_threads);
+}
+
+template<class Pixel>
+void boxFilter(ImageView<Pixel> img, std::size_t radius, MutableImageView<Pixel> out, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->boxFilter(img, radius, out, num_threads);
+}
+
+template<class Pixel>
+bool boxFilter(ImageView<Pixel> img, std::size_t radius, MutableImageView<Pixel> out, FilterWorkspace<Pixel>& ws, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    return defaultIntegralEngine(num_threads)->boxFilter(img, radius, out, ws, num_threads);
+}
+
+template<class Pixel>
+void boxFilter(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::size_t radius, std::vector<Pixel>& out, int num_threads) noexcept{
+    if(w==0 || h==0) { out.clear(); return; }
+    out.resize(w*h);
+    boxFilter(ImageView<Pixel>(img, w, h), radius, MutableImageView<Pixel>(out, w, h), num_threads);
+}
+
+template<class Pixel>
+bool IntegralEngine::adaptiveThreshold(ImageView<Pixel> img, MutableImageView<u8> mask, const ThresholdParams& params, FilterWorkspace<Pixel>& ws, int num_threads) noexcept{
+    using Acc = typename BoxSum<Pixel>::type;
+    const size_t w = img.width, h = img.height;
+    if(w==0 || h==0) return true;
+    if(num_threads < 1 || num_threads > pool_->size()) num_threads = pool_->size();
+    const bool sauvola = params.method == ThresholdMethod::Sauvola;
+
+    size_t rows_per = windowBandRows(h, params.radius, num_threads);
+    if(!reserveBands(ws, w, h, rows_per, sauvola)) return false;
+    size_t bands = (h + rows_per - 1) / rows_per;
+    Acc* scratch = ws.sums();
+    u64* scratchSq = ws.squares();
+
+    pool_->run(bands, [&](size_t b){
+        const auto thresholdRow = integralKernels<Pixel, Acc>().thresholdRow;
+        const auto prefixRow = integralKernels<Acc, Acc>().rowPrefix;
+        const auto prefixRowSq = integralKernels<u64, u64>().rowPrefix;
+        Acc* s = scratch + 4*b*w;
+        u64* q = sauvola ? scratchSq + 4*b*w : nullptr;
+        WindowColumns<Pixel, Acc> win{img, params.radius, s, s + w, s + 2*w};
+        WindowColumns<Pixel, u64, true> winSq{img, params.radius, q, q + w, q + 2*w};
+        Acc* prefix = s + 3*w;
+        u64* prefixSq = sauvola ? q + 3*w : nullptr;
+        size_t y0 = b*rows_per;
+        size_t y1 = std::min(h, y0 + rows_per);
+        win.start(y0);
+        if(sauvola) winSq.start(y0);
+        for(size_t y=y0;y<y1;++y){
+            size_t rows = win.advance(y);
+            prefixRow(win.window, nullptr, prefix, w, 0);
+            if(sauvola){
+                winSq.advance(y);
+                prefixRowSq(winSq.window, nullptr, prefixSq, w, 0);
+            }
+            thresholdRow(img.row(y), prefix, prefixSq, mask.row(y), w, rows, params);
+        }
+    });
+    return true;
+}
+
+template<class Pixel>
+void IntegralEngine::adaptiveThreshold(ImageView<Pixel> img, MutableImageView<u8> mask, const ThresholdParams& params, int num_threads) noexcept{
+    FilterWorkspace<Pixel> ws;
+    adaptiveThreshold(img, mask, params, ws, num_threads);
+}
+
+template<class Pixel>
+void adaptiveThreshold(ImageView<Pixel> img, MutableImageView<u8> mask, const ThresholdParams& params, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->adaptiveThreshold(img, mask, params, num_threads);
+}
+
+template<class Pixel>
+bool adaptiveThreshold(ImageView<Pixel> img, MutableImageView<u8> mask, const ThresholdParams& params, FilterWorkspace<Pixel>& ws, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    return defaultIntegralEngine(num_threads)->adaptiveThreshold(img, mask, params, ws, num_threads);
+}
+
+template<class Pixel>
+void adaptiveThreshold(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<u8>& mask, const ThresholdParams& params, int num_threads) noexcept{
+    if(w==0 || h==0) { mask.clear(); return; }
+    mask.resize(w*h);
+    adaptiveThreshold(ImageView<Pixel>(img, w, h), MutableImageView<u8>(mask, w, h), params, num_threads);
+}
+
+#define INTEGRAL_INSTANTIATE_THRESHOLD(Pixel) \
+    template void IntegralEngine::adaptiveThreshold<Pixel>(ImageView<Pixel>, MutableImageView<u8>, const ThresholdParams&, int) noexcept; \
+    template bool IntegralEngine::adaptiveThreshold<Pixel>(ImageView<Pixel>, MutableImageView<u8>, const ThresholdParams&, FilterWorkspace<Pixel>&, int) noexcept; \
+    template bool adaptiveThreshold<Pixel>(ImageView<Pixel>, MutableImageView<u8>, const ThresholdParams&, FilterWorkspace<Pixel>&, int) noexcept; \
+    template void adaptiveThreshold<Pixel>(ImageView<Pixel>, MutableImageView<u8>, const ThresholdParams&, int) noexcept; \
+    template void adaptiveThreshold<Pixel>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<u8>&, const ThresholdParams&, int) noexcept;
+INTEGRAL_INSTANTIATE_THRESHOLD(u8)
+INTEGRAL_INSTANTIATE_THRESHOLD(u16)
+
+#define INTEGRAL_INSTANTIATE_FILTERS(Pixel) \
+    template void IntegralEngine::boxFilter<Pixel>(ImageView<Pixel>, std::size_t, MutableImageView<Pixel>, int) noexcept; \
+    template bool IntegralEngine::boxFilter<Pixel>(ImageView<Pixel>, std::size_t, MutableImageView<Pixel>, FilterWorkspace<Pixel>&, int) noexcept; \
+    template bool boxFilter<Pixel>(ImageView<Pixel>, std::size_t, MutableImageView<Pixel>, FilterWorkspace<Pixel>&, int) noexcept; \
+    template void boxFilter<Pixel>(ImageView<Pixel>, std::size_t, MutableImageView<Pixel>, int) noexcept; \
+    template void boxFilter<Pixel>(const std::vector<Pixel>&, std::size_t, std::size_t, std::size_t, std::vector<Pixel>&, int) noexcept;
+INTEGRAL_INSTANTIATE_FILTERS(u8)
+INTEGRAL_INSTANTIATE_FILTERS(u16)
+INTEGRAL_INSTANTIATE_FILTERS(float)
@@ -0,0 +1,60 @@
+// integral_gather.inl
+// Instruction-set independent body of the batched rectangle-sum kernel.
+// integral_simd.cpp includes this file in the AVX2 and AVX-512 namespaces,
+// after defining RectLanes<Acc> for u32, u64 and double.
+//
+// RectLanes<Acc> provides: N (rectangles per step), Idx (N 64-bit offsets),
+// Mask (N lane flags), V (N accumulators), loadCoord (widen N u32), set1, add,
+// sub, mulStride (32x32->64 multiply), nonzero, both, gather, maskGather
+// (masked-off lanes read nothing and yield 0), combine (a - b - c + d), store.
+
+// Corner offsets are formed in 64 bits, so tables larger than 2^32 elements
+// work; rows above and columns left of the table are masked out of the
+// gathers instead of branched on.
+template<class Acc>
+static void rectSums(const Acc* table, size_t stride, const u32* x0, const u32* y0, const u32* x1, const u32* y1, Acc* out, size_t n) noexcept{
+    using L = RectLanes<Acc>;
+    const typename L::Idx s = L::set1(stride), one = L::set1(1);
+    size_t i = 0;
+    for(;i+L::N<=n;i+=L::N){
+        typename L::Idx X0 = L::loadCoord(x0 + i), Y0 = L::loadCoord(y0 + i);
+        typename L::Idx X1 = L::loadCoord(x1 + i), Y1 = L::loadCoord(y1 + i);
+        typename L::Mask mx = L::nonzero(X0), my = L::nonzero(Y0);
+        typename L::Idx bottom = L::mulStride(Y1, s);
+        typename L::Idx top = L::mulStride(L::sub(Y0, one), s);
+        typename L::Idx left = L::sub(X0, one);
+        typename L::V a = L::gather(table, L::add(bottom, X1));
+        typename L::V b = L::maskGather(table, L::add(top, X1), my);
+        typename L::V c = L::maskGather(table, L::add(bottom, left), mx);
+        typename L::V d = L::maskGather(table, L::add(top, left), L::both(mx, my));
+        L::store(out + i, L::combine(a, b, c, d));
+    }
+    rectSumsScalar<Acc>(table, stride, x0 + i, y0 + i, x1 + i, y1 + i, out + i, n - i);
+}
+
+// ZeroPadded tables: every corner is inside the table, so all four gathers
+// are unmasked.
+template<class Acc>
+static void paddedRectSums(const Acc* table, size_t stride, const u32* x0, const u32* y0, const u32* x1, const u32* y1, Acc* out, size_t n) noexcept{
+    using L = RectLanes<Acc>;
+    const typename L::Idx s = L::set1(stride), one = L::set1(1);
+    size_t i = 0;
+    for(;i+L::N<=n;i+=L::N){
+        typename L::Idx X0 = L::loadCoord(x0 + i), Y0 = L::loadCoord(y0 + i);
+        typename L::Idx X1 = L::add(L::loadCoord(x1 + i), one), Y1 = L::add(L::loadCoord(y1 + i), one);
+        typename L::Idx bottom = L::mulStride(Y1, s);
+        typename L::Idx top = L::mulStride(Y0, s);
+        typename L::V a = L::gather(table, L::add(bottom, X1));
+        typename L::V b = L::gather(table, L::add(top, X1));
+        typename L::V c = L::gather(table, L::add(bottom, X0));
+        typename L::V d = L::gather(table, L::add(top, X0));
+        L::store(out + i, L::combine(a, b, c, d));
+    }
+    paddedRectSumsScalar<Acc>(table, stride, x0 + i, y0 + i, x1 + i, y1 + i, out + i, n - i);
+}
+
+template<class Acc>
+static const RectKernels<Acc>* rectTable() noexcept{
+    static const RectKernels<Acc> kernels = {rectSums<Acc>, paddedRectSums<Acc>};
+    return &kernels;
+}
@@ -0,0 +1,148 @@
+// integral_histogram.cpp
+// Integral histogram (IntegralHistogram): one summed-area table per bin, built
+// on the IntegralEngine band split used by computeIntegralMulti.
+//
+// Phase 1 counts each band's bins per column, the serial step turns those
+// counts into the table row just above every band, and phase 2 sweeps each
+// band row by row, adding the running row histogram to the row above.
+
+#include "integral.hpp"
+#include "integral_kernels.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+using std::size_t;
+
+// False if even the scratch of a single band cannot be allocated.
+template<class Count>
+static bool histogramBands(ThreadPool& pool, ImageView<u8> img, const u8* lut, size_t bins, Count* table, size_t threads) noexcept{
+    const size_t w = img.width, h = img.height, row = w*bins;
+    const auto histogramRow = histogramKernels<Count>().histogramRow;
+    size_t rows_per = (h + threads - 1) / threads;
+    size_t bands = (h + rows_per - 1) / rows_per;
+    // per band: the running row histogram; per band but the last: its column
+    // counts, replaced in place by the table row that ends it
+    BufferPtr<Count> scratch = makeBuffer<Count>(bands*bins + (bands-1)*row + row, BufferPages::Default);
+    if(!scratch && bands > 1){
+        // one band starts from zero and needs no column counts from above
+        rows_per = h;
+        bands = 1;
+        scratch = makeBuffer<Count>(bins + row, BufferPages::Default);
+    }
+    if(!scratch) return false;
+    auto carryOf = [&](size_t b){ return scratch.get() + b*bins; };
+    auto edgeOf = [&](size_t b){ return scratch.get() + bands*bins + b*row; };
+    Count* columns = edgeOf(bands-1);
+
+    // Phase 1: bin counts of every column over each band's rows
+    pool.run(bands-1, [&](size_t b){
+        Count* c = edgeOf(b);
+        std::fill(c, c + row, Count(0));
+        for(size_t y=b*rows_per;y<(b+1)*rows_per;++y){
+            const u8* in = img.row(y);
+            for(size_t x=0;x<w;++x) ++c[x*bins + lut[in[x]]];
+        }
+    });
+
+    // Column counts over bands [0, b] and their prefix along the row give the
+    // table row ending band b
+    std::fill(columns, columns + row, Count(0));
+    for(size_t b=0;b+1<bands;++b){
+        Count* edge = edgeOf(b);
+        Count* run = carryOf(b);
+        std::fill(run, run + bins, Count(0));
+        for(size_t x=0;x<w;++x){
+            for(size_t k=0;k<bins;++k){
+                columns[x*bins + k] = static_cast<Count>(columns[x*bins + k] + edge[x*bins + k]);
+                run[k] = static_cast<Count>(run[k] + columns[x*bins + k]);
+                edge[x*bins + k] = run[k];
+            }
+        }
+    }
+
+    // Phase 2: each band continues from the row ending the band above it
+    pool.run(bands, [&](size_t b){
+        size_t y0 = b*rows_per;
+        size_t y1 = std::min(h, y0 + rows_per);
+        const Count* prev = b ? edgeOf(b-1) : nullptr;
+        Count* carry = carryOf(b);
+        for(size_t y=y0;y<y1;++y){
+            Count* out = table + y*row;
+            std::fill(carry, carry + bins, Count(0));
+            histogramRow(img.row(y), lut, prev, out, w, bins, carry);
+            prev = out;
+        }
+    });
+    return true;
+}
+
+void IntegralEngine::computeHistogram(ImageView<u8> img, unsigned bins, IntegralHistogram& hist, int num_threads, bool allow_wrapping) noexcept{
+    const size_t w = img.width, h = img.height;
+    bins = std::min(std::max(bins, 1u), 256u);
+    // an empty histogram (bins() == 0) reports a table that cannot be held
+    auto fail = [&]{
+        std::visit([](auto& table){ table.clear(); }, hist.table_);
+        hist.width_ = hist.height_ = 0;
+        hist.bins_ = 0;
+        hist.wrapping_ = false;
+    };
+    if(h && w > static_cast<size_t>(-1) / h / bins) { fail(); return; }
+    hist.width_ = w;
+    hist.height_ = h;
+    hist.bins_ = bins;
+    const bool narrow = w*h < (size_t(1) << 16);
+    hist.wrapping_ = !narrow && allow_wrapping;
+    if(num_threads < 1 || num_threads > pool_->size()) num_threads = pool_->size();
+    const size_t threads = static_cast<size_t>(num_threads);
+
+    u8 lut[256];
+    for(unsigned v=0;v<256;++v) lut[v] = static_cast<u8>(v*bins/256);
+
+    auto build = [&](auto& table){
+        using Count = typename std::remove_reference_t<decltype(table)>::value_type;
+        try{ table.resize(w*h*bins); }
+        catch(...){ return false; }
+        return !(w && h) || histogramBands<Count>(*pool_, img, lut, bins, table.data(), threads);
+    };
+    // keep the previous table's storage when the counter type is unchanged
+    bool ok;
+    if(narrow || allow_wrapping){
+        if(hist.table_.index() != 0) hist.table_ = std::vector<u16>();
+        ok = build(std::get<0>(hist.table_));
+    }else{
+        if(hist.table_.index() != 1) hist.table_ = std::vector<u32>();
+        ok = build(std::get<1>(hist.table_));
+    }
+    if(!ok) fail();
+}
+
+void IntegralHistogram::compute(ImageView<u8> img, unsigned bins, int num_threads, bool allow_wrapping) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeHistogram(img, bins, *this, num_threads, allow_wrapping);
+}
+
+void IntegralHistogram::compute(const std::vector<u8>& img, std::size_t w, std::size_t h, unsigned bins, int num_threads, bool allow_wrapping) noexcept{
+    compute(ImageView<u8>(img, w, h), bins, num_threads, allow_wrapping);
+}
+
+// Corners above or left of the table read a run of zeros.
+template<class Count>
+static void queryHistogram(const std::vector<Count>& table, size_t w, size_t bins, size_t x0, size_t y0, size_t x1, size_t y1, u32* hist) noexcept{
+    static const Count zeros[256] = {};
+    const size_t row = w*bins;
+    const Count* br = table.data() + y1*row + x1*bins;
+    const Count* tr = y0 ? br - (y1 - y0 + 1)*row : zeros;
+    const Count* bl = x0 ? br - (x1 - x0 + 1)*bins : zeros;
+    const Count* tl = (x0 && y0) ? bl - (y1 - y0 + 1)*row : zeros;
+    histogramKernels<Count>().rectHistogram(br, tr, bl, tl, hist, bins);
+}
+
+void IntegralHistogram::query(std::size_t x0, std::size_t y0, std::size_t x1, std::size_t y1, u32* hist) const noexcept{
+    if(table_.index() == 0) queryHistogram(std::get<0>(table_), width_, bins_, x0, y0, x1, y1, hist);
+    else queryHistogram(std::get<1>(table_), width_, bins_, x0, y0, x1, y1, hist);
+}
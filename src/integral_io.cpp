@@ -0,0 +1,366 @@
+// integral_io.cpp
+// File-backed integral computation on POSIX file descriptors: the out-of-core
+// strip engine (computeIntegralFile), mmap readers for raw and PGM / PPM
+// images (MappedImage) and mapped integral output files (MappedIntegral).
+
+#include "integral.hpp"
+#include "integral_kernels.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::size_t;
+
+// pread / pwrite until n bytes are done; false on error or end of file.
+static bool readAll(int fd, void* buf, size_t n, u64 offset) noexcept{
+    char* p = static_cast<char*>(buf);
+    while(n){
+        ssize_t r = ::pread(fd, p, n, static_cast<off_t>(offset));
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return false;
+        p += r; n -= static_cast<size_t>(r); offset += static_cast<u64>(r);
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void* buf, size_t n, u64 offset) noexcept{
+    const char* p = static_cast<const char*>(buf);
+    while(n){
+        ssize_t r = ::pwrite(fd, p, n, static_cast<off_t>(offset));
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return false;
+        p += r; n -= static_cast<size_t>(r); offset += static_cast<u64>(r);
+    }
+    return true;
+}
+
+// Closes the descriptor on every return path.
+struct FileHandle {
+    int fd;
+    explicit FileHandle(int f) noexcept : fd(f) {}
+    ~FileHandle(){ if(fd >= 0) ::close(fd); }
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+};
+
+template<class Pixel, class Acc>
+bool computeIntegralFile(const std::string& input, const std::string& output, std::size_t w, std::size_t h, const OutOfCoreOptions& options) noexcept{
+    FileHandle in(::open(input.c_str(), O_RDONLY));
+    FileHandle out(::open(output.c_str(), O_RDWR | O_CREAT, 0644));
+    if(in.fd < 0 || out.fd < 0) return false;
+    const u64 inRow = static_cast<u64>(w)*sizeof(Pixel), outRow = static_cast<u64>(w)*sizeof(Acc);
+    if(::ftruncate(out.fd, static_cast<off_t>(options.outputOffset + outRow*h)) != 0) return false;
+    if(w == 0 || h == 0) return true;
+
+    size_t rows = options.stripRows;
+    if(rows == 0) rows = std::max<size_t>(1, options.memoryBudget / (2*(inRow + outRow)));
+    rows = std::min(rows, h);
+    const size_t strips = (h + rows - 1) / rows;
+    if(rows > static_cast<size_t>(-1) / 2 / w) return false;
+    BufferPtr<Pixel> inBuf = makeBuffer<Pixel>(2*rows*w, BufferPages::Default);
+    BufferPtr<Acc> outBuf = makeBuffer<Acc>(2*rows*w, BufferPages::Default);
+    if(!inBuf || !outBuf) return false;
+    auto inStrip = [&](size_t s){ return inBuf.get() + (s & 1)*rows*w; };
+    auto outStrip = [&](size_t s){ return outBuf.get() + (s & 1)*rows*w; };
+    auto stripHeight = [&](size_t s){ return std::min(rows, h - s*rows); };
+    auto read = [&](size_t s){ return readAll(in.fd, inStrip(s), stripHeight(s)*inRow, options.inputOffset + s*rows*inRow); };
+    auto write = [&](size_t s){ return writeAll(out.fd, outStrip(s), stripHeight(s)*outRow, options.outputOffset + s*rows*outRow); };
+
+    // One I/O thread writes strip s-1 and reads strip s+1 while strip s is
+    // integrated. The buffers of s are reused by s+2: its read waits until s
+    // is integrated, and integrating s+2 waits until s is written.
+    std::mutex m;
+    std::condition_variable cv;
+    size_t readDone = 0, writeDone = 0, computed = 0;
+    bool failed = false;
+    auto finished = [&](bool ok, size_t& done){
+        std::lock_guard<std::mutex> lk(m);
+        if(ok) ++done; else failed = true;
+        cv.notify_all();
+        return ok;
+    };
+    auto io = [&]{
+        for(size_t s=0;s<std::min<size_t>(2, strips);++s) if(!finished(read(s), readDone)) return;
+        for(size_t s=0;s<strips;++s){
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv.wait(lk, [&]{ return computed > s; });
+            }
+            if(!finished(write(s), writeDone)) return;
+            if(s+2 < strips && !finished(read(s+2), readDone)) return;
+        }
+    };
+    std::thread ioThread;
+    try{ ioThread = std::thread(io); }
+    catch(...){ return false; }
+
+    const auto rowPrefix = integralKernels<Pixel, Acc>().rowPrefix;
+    for(size_t s=0;s<strips;++s){
+        {
+            std::unique_lock<std::mutex> lk(m);
+            cv.wait(lk, [&]{ return failed || (readDone > s && writeDone + 2 > s); });
+            if(failed) break;
+        }
+        const Pixel* src = inStrip(s);
+        Acc* dst = outStrip(s);
+        // the last row of strip s-1 stays readable: its buffer is only being written out
+        const Acc* prev = s ? outStrip(s-1) + (rows-1)*w : nullptr;
+        for(size_t y=0;y<stripHeight(s);++y){
+            rowPrefix(src + y*w, prev, dst + y*w, w, Acc(0));
+            prev = dst + y*w;
+        }
+        std::lock_guard<std::mutex> lk(m);
+        computed = s+1;
+        cv.notify_all();
+    }
+    ioThread.join();
+    return !failed;
+}
+
+#define INTEGRAL_INSTANTIATE_FILE(Pixel, Acc) \
+    template bool computeIntegralFile<Pixel, Acc>(const std::string&, const std::string&, std::size_t, std::size_t, const OutOfCoreOptions&) noexcept;
+INTEGRAL_INSTANTIATE_FILE(u8, u32)
+INTEGRAL_INSTANTIATE_FILE(u16, u32)
+INTEGRAL_INSTANTIATE_FILE(u32, u32)
+INTEGRAL_INSTANTIATE_FILE(u8, u64)
+INTEGRAL_INSTANTIATE_FILE(u16, u64)
+INTEGRAL_INSTANTIATE_FILE(u32, u64)
+INTEGRAL_INSTANTIATE_FILE(float, double)
+
+FileMapping::~FileMapping(){ close(); }
+
+FileMapping::FileMapping(FileMapping&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)), writable_(other.writable_) {}
+
+FileMapping& FileMapping::operator=(FileMapping&& other) noexcept{
+    if(this != &other){
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        writable_ = other.writable_;
+    }
+    return *this;
+}
+
+void FileMapping::close() noexcept{
+    if(data_) ::munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+    writable_ = false;
+}
+
+bool FileMapping::map(const std::string& path, bool writable, std::size_t size) noexcept{
+    close();
+    FileHandle f(::open(path.c_str(), writable ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644));
+    if(f.fd < 0) return false;
+    if(writable){
+        if(::ftruncate(f.fd, static_cast<off_t>(size)) != 0) return false;
+    }else{
+        struct stat st;
+        if(::fstat(f.fd, &st) != 0) return false;
+        size = static_cast<size_t>(st.st_size);
+    }
+    if(size == 0) return false;
+    void* p = ::mmap(nullptr, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, f.fd, 0);
+    if(p == MAP_FAILED) return false;
+    data_ = static_cast<char*>(p);
+    size_ = size;
+    writable_ = writable;
+    return true;
+}
+
+// a*b*c*d, false if it does not fit in 64 bits (header fields come from
+// untrusted files, and a wrapped size would pass the file size checks).
+static bool sizeProduct(u64 a, u64 b, u64 c, u64 d, u64& out) noexcept{
+    return !__builtin_mul_overflow(a, b, &out) && !__builtin_mul_overflow(out, c, &out) && !__builtin_mul_overflow(out, d, &out);
+}
+
+// Next unsigned number of a PNM header, skipping whitespace and # comments.
+static bool pnmNumber(const char* data, size_t size, size_t& pos, u64& value) noexcept{
+    while(pos < size){
+        char c = data[pos];
+        if(c == '#') { while(pos < size && data[pos] != '\n') ++pos; }
+        else if(c == ' ' || c == '\t' || c == '\n' || c == '\r') ++pos;
+        else break;
+    }
+    if(pos >= size || data[pos] < '0' || data[pos] > '9') return false;
+    value = 0;
+    while(pos < size && data[pos] >= '0' && data[pos] <= '9'){
+        value = value*10 + static_cast<u64>(data[pos++] - '0');
+        if(value > (u64(1) << 32)) return false;
+    }
+    return true;
+}
+
+bool MappedImage::openPnm(const std::string& path) noexcept{
+    // a failed open must not leave the previous image's pixel pointer behind
+    *this = MappedImage();
+    if(!map(path, false)) return false;
+    size_t pos = 2;
+    u64 w = 0, h = 0, maxval = 0;
+    bool ok = size_ > 2 && data_[0] == 'P' && (data_[1] == '5' || data_[1] == '6')
+           && pnmNumber(data_, size_, pos, w) && pnmNumber(data_, size_, pos, h) && pnmNumber(data_, size_, pos, maxval)
+           && maxval > 0 && maxval < 65536 && pos < size_;
+    unsigned channels = ok && data_[1] == '6' ? 3 : 1, bytes = maxval < 256 ? 1 : 2;
+    // exactly one whitespace byte separates maxval from the samples
+    u64 bytesNeeded = 0;
+    ok = ok && sizeProduct(w, h, channels, bytes, bytesNeeded) && size_ - (pos + 1) >= bytesNeeded;
+    if(!ok){ close(); return false; }
+    pixels_ = data_ + pos + 1;
+    width_ = static_cast<size_t>(w);
+    height_ = static_cast<size_t>(h);
+    channels_ = channels;
+    bytes_ = bytes;
+    bigEndian_ = bytes == 2;
+    return true;
+}
+
+bool MappedImage::openRaw(const std::string& path, std::size_t w, std::size_t h, unsigned channels, unsigned bytesPerSample, u64 offset) noexcept{
+    *this = MappedImage();
+    if(!map(path, false)) return false;
+    u64 bytesNeeded = 0;
+    if(channels == 0 || (bytesPerSample != 1 && bytesPerSample != 2) || offset > size_
+       || !sizeProduct(w, h, channels, bytesPerSample, bytesNeeded) || size_ - offset < bytesNeeded){
+        close();
+        return false;
+    }
+    pixels_ = data_ + offset;
+    width_ = w;
+    height_ = h;
+    channels_ = channels;
+    bytes_ = bytesPerSample;
+    bigEndian_ = false;
+    return true;
+}
+
+static bool hostBigEndian() noexcept{
+    const u16 one = 1;
+    return *reinterpret_cast<const u8*>(&one) == 0;
+}
+
+template<class Sample>
+ImageView<Sample> MappedImage::samples() const noexcept{
+    if(!pixels_ || sizeof(Sample) != bytes_ || (bytes_ == 2 && bigEndian_ != hostBigEndian())) return ImageView<Sample>();
+    return ImageView<Sample>(reinterpret_cast<const Sample*>(pixels_), width_*channels_, height_);
+}
+
+template<class Pixel>
+bool MappedImage::copyTo(std::vector<Pixel>& out) const noexcept{
+    if(!pixels_ || sizeof(Pixel) < bytes_) return false;
+    const size_t n = width_*height_*channels_;
+    out.resize(n);
+    const u8* p = reinterpret_cast<const u8*>(pixels_);
+    if(bytes_ == 1){
+        for(size_t i=0;i<n;++i) out[i] = p[i];
+    }else if(bigEndian_ != hostBigEndian()){
+        for(size_t i=0;i<n;++i) out[i] = static_cast<Pixel>(bigEndian_ ? (p[2*i] << 8) | p[2*i+1] : p[2*i] | (p[2*i+1] << 8));
+    }else{
+        for(size_t i=0;i<n;++i){
+            u16 v;
+            std::memcpy(&v, p + 2*i, 2);
+            out[i] = v;
+        }
+    }
+    return true;
+}
+
+static const char kIntegralMagic[8] = {'I','N','T','E','G','R','L','1'};
+static_assert(sizeof(IntegralFileHeader) == 64, "IntegralFileHeader must stay 64 bytes");
+
+// Rows of one table and number of tables in a mapped integral file.
+static u64 tableRows(const IntegralFileHeader& hd) noexcept{ return hd.height + (hd.layout == static_cast<u32>(IntegralLayout::ZeroPadded)); }
+static u64 tableCount(const IntegralFileHeader& hd) noexcept{ return hd.planar ? hd.channels : 1; }
+
+template<class Acc>
+bool MappedIntegral::create(const std::string& path, std::size_t w, std::size_t h, unsigned channels, IntegralLayout layout, bool planar) noexcept{
+    IntegralFileHeader hd{};
+    std::memcpy(hd.magic, kIntegralMagic, sizeof(hd.magic));
+    const bool padded = layout == IntegralLayout::ZeroPadded;
+    channels = std::max(channels, 1u);
+    hd.width = w;
+    hd.height = h;
+    hd.channels = channels;
+    hd.dataOffset = sizeof(IntegralFileHeader);
+    hd.accBytes = sizeof(Acc);
+    hd.accFloat = std::is_floating_point<Acc>::value;
+    hd.layout = static_cast<u32>(layout);
+    hd.planar = planar;
+    // the same checks as open(): a wrapped size would map a short file
+    u64 bytes = 0;
+    if(hd.width == ~u64(0) || hd.height == ~u64(0)
+       || !sizeProduct(hd.width + padded, planar ? 1 : channels, 1, 1, hd.stride)
+       || !sizeProduct(tableCount(hd), tableRows(hd), hd.stride, sizeof(Acc), bytes)
+       || bytes > static_cast<u64>(static_cast<size_t>(-1)) - hd.dataOffset){
+        close();
+        return false;
+    }
+    if(!map(path, true, static_cast<size_t>(hd.dataOffset + bytes))) return false;
+    std::memcpy(data_, &hd, sizeof(hd));
+    return true;
+}
+
+bool MappedIntegral::open(const std::string& path) noexcept{
+    if(!map(path, false)) return false;
+    if(size_ < sizeof(IntegralFileHeader) || std::memcmp(data_, kIntegralMagic, sizeof(kIntegralMagic)) != 0){ close(); return false; }
+    const IntegralFileHeader& hd = header();
+    // rows must hold a full row of entries, entries must be aligned, and all
+    // tables must fit in the file, without any product wrapping
+    const u64 padded = hd.layout == static_cast<u32>(IntegralLayout::ZeroPadded);
+    u64 rowEntries = 0, entries = 0;
+    if(hd.dataOffset < sizeof(IntegralFileHeader) || hd.dataOffset > size_ || (hd.accBytes != 4 && hd.accBytes != 8)
+       || hd.dataOffset % hd.accBytes != 0 || hd.channels == 0 || hd.layout > 1 || hd.width == ~u64(0) || hd.height == ~u64(0)
+       || !sizeProduct(hd.width + padded, hd.planar ? 1 : hd.channels, 1, 1, rowEntries) || hd.stride < rowEntries
+       || !sizeProduct(tableCount(hd), tableRows(hd), hd.stride, 1, entries)
+       || (size_ - hd.dataOffset) / hd.accBytes < entries){
+        close();
+        return false;
+    }
+    return true;
+}
+
+template<class Acc>
+MutableImageView<Acc> MappedIntegral::table(unsigned plane) noexcept{
+    if(!writable_) return MutableImageView<Acc>();
+    ImageView<Acc> v = view<Acc>(plane);
+    return MutableImageView<Acc>(const_cast<Acc*>(v.data), v.width, v.height, v.stride);
+}
+
+template<class Acc>
+ImageView<Acc> MappedIntegral::view(unsigned plane) const noexcept{
+    if(!data_) return ImageView<Acc>();
+    const IntegralFileHeader& hd = header();
+    if(hd.accBytes != sizeof(Acc) || hd.accFloat != std::is_floating_point<Acc>::value || plane >= tableCount(hd)) return ImageView<Acc>();
+    const size_t rows = static_cast<size_t>(tableRows(hd)), stride = static_cast<size_t>(hd.stride);
+    return ImageView<Acc>(reinterpret_cast<const Acc*>(data_ + hd.dataOffset) + plane*rows*stride, stride, rows);
+}
+
+bool MappedIntegral::sync() noexcept{
+    return data_ && ::msync(data_, size_, MS_SYNC) == 0;
+}
+
+template ImageView<u8> MappedImage::samples<u8>() const noexcept;
+template ImageView<u16> MappedImage::samples<u16>() const noexcept;
+template bool MappedImage::copyTo<u8>(std::vector<u8>&) const noexcept;
+template bool MappedImage::copyTo<u16>(std::vector<u16>&) const noexcept;
+template bool MappedImage::copyTo<u32>(std::vector<u32>&) const noexcept;
+
+#define INTEGRAL_INSTANTIATE_MAPPED(Acc) \
+    template bool MappedIntegral::create<Acc>(const std::string&, std::size_t, std::size_t, unsigned, IntegralLayout, bool) noexcept; \
+    template MutableImageView<Acc> MappedIntegral::table<Acc>(unsigned) noexcept; \
+    template ImageView<Acc> MappedIntegral::view<Acc>(unsigned) const noexcept;
+INTEGRAL_INSTANTIATE_MAPPED(u32)
+INTEGRAL_INSTANTIATE_MAPPED(u64)
+INTEGRAL_INSTANTIATE_MAPPED(double)
@@ -0,0 +1,160 @@
+// integral_kernels.hpp
+// Internal row and column kernels shared by the integral image engines, with runtime CPU dispatch.
+// Kernels exist for every (pixel, accumulator) pair instantiated in integral.hpp, plus
+// (double, double) for the squared tables of float images and (u64, u64) for prefix
+// sums over u64 column sums.
+// See src/integral_simd.cpp for implementations.
+
+#ifndef INTEGRAL_KERNELS_HPP
+#define INTEGRAL_KERNELS_HPP
+
+#include "integral.hpp"
+
+enum class SimdLevel { Scalar, SSE41, AVX2, AVX512 };
+
+/** Highest instruction set supported by the running CPU (cpuid), capped by INTEGRAL_SIMD if set. */
+SimdLevel simdLevel() noexcept;
+
+/** Human-readable name of a SIMD level ("scalar", "sse4.1", "avx2", "avx512"). */
+const char* simdLevelName(SimdLevel level) noexcept;
+
+/** One implementation of every kernel, all targeting the same instruction set. */
+template<class Pixel, class Acc>
+struct IntegralKernels {
+    /**
+     * Row prefix kernel: out[i] = carry + in[0] + ... + in[i] (+ prev[i] when prev != nullptr).
+     *
+     * @param in Input row (n pixels).
+     * @param prev Integral row directly above `out`, or nullptr for the first row.
+     * @param out Output row (n elements).
+     * @param n Number of pixels.
+     * @param carry Running row sum entering the row (sum of the pixels left of in[0]).
+     * @return Running row sum after in[n-1], i.e. the carry for the next chunk of the same row.
+     */
+    Acc (*rowPrefix)(const Pixel* in, const Acc* prev, Acc* out, std::size_t n, Acc carry) noexcept;
+
+    /** Column accumulation: acc[i] += in[i] for i < n (one input row into a running column sum). */
+    void (*columnSum)(const Pixel* in, Acc* acc, std::size_t n) noexcept;
+
+    /** Row reduction: returns in[0] + ... + in[n-1]. */
+    Acc (*rowSum)(const Pixel* in, std::size_t n) noexcept;
+
+    /**
+     * One row of the 45-degree tilted integral (n >= 1). With P the inclusive
+     * prefix sum of `in` (written to `prefix`), updates the diagonal states of
+     * the previous row in place: right[x] += P[x] taken from right[x+1] (the
+     * last element keeps its own), left[x] = left[x-1] + P[x-1] (left[0] = 0),
+     * and writes out[x] = right[x] - left[x] unless out is nullptr.
+     */
+    void (*tiltedRow)(const Pixel* in, Acc* prefix, Acc* right, Acc* left, Acc* out, std::size_t n) noexcept;
+
+    /**
+     * One output row of a (2r+1) x (2r+1) box filter whose window spans `rows`
+     * image rows: prefix is the inclusive prefix sum (n >= 1) of the window's
+     * column sums, and out[x] is the mean over columns [x-r, x+r] clipped to
+     * [0, n), rounded to nearest for integer pixels.
+     */
+    void (*boxRow)(const Acc* prefix, Pixel* out, std::size_t n, std::size_t r, std::size_t rows) noexcept;
+
+    /**
+     * One output row of adaptiveThreshold: like boxRow, with prefixSq the prefix
+     * of the squared window column sums (unused for Bradley); out[x] is 255 where
+     * in[x] is above the local threshold and 0 elsewhere.
+     */
+    void (*thresholdRow)(const Pixel* in, const Acc* prefix, const u64* prefixSq, u8* out, std::size_t n, std::size_t rows, const ThresholdParams& params) noexcept;
+
+    /** Column accumulation of a pixel change: acc[i] += cur[i] - old[i] in Acc arithmetic, for i < n. */
+    void (*deltaColumns)(const Pixel* cur, const Pixel* old, Acc* acc, std::size_t n) noexcept;
+};
+
+/** Batched rectangle-sum kernel over one integral table (see computeRectSums). */
+template<class Acc>
+struct RectKernels {
+    /**
+     * out[i] = sum of the inclusive rectangle [x0[i], x1[i]] x [y0[i], y1[i]]
+     * for i < n, from a table with `stride` elements per row.
+     */
+    void (*rectSums)(const Acc* table, std::size_t stride, const u32* x0, const u32* y0, const u32* x1, const u32* y1, Acc* out, std::size_t n) noexcept;
+
+    /** rectSums for a ZeroPadded table (no border cases): `table` points at its zero corner. */
+    void (*paddedRectSums)(const Acc* table, std::size_t stride, const u32* x0, const u32* y0, const u32* x1, const u32* y1, Acc* out, std::size_t n) noexcept;
+};
+
+/**
+ * Rectangle kernels for a given level (gathers from AVX2 up; SSE4.1 uses the
+ * scalar kernel), or nullptr if the CPU cannot run them. Acc is u32, u64 or double.
+ */
+template<class Acc>
+const RectKernels<Acc>* rectKernels(SimdLevel level) noexcept;
+
+/** Rectangle kernels for simdLevel(); resolved once per process. */
+template<class Acc>
+const RectKernels<Acc>& rectKernels() noexcept;
+
+/** Integral histogram kernels over bin-interleaved tables (see IntegralHistogram); Count is u16 or u32. */
+template<class Count>
+struct HistogramKernels {
+    /**
+     * One table row: for each x < n, adds pixel in[x] to the running row
+     * histogram carry[lut[in[x]]], then writes the `bins` counters of pixel x,
+     * out[x*bins + b] = carry[b] + prev[x*bins + b] (prev == nullptr for the first row).
+     */
+    void (*histogramRow)(const u8* in, const u8* lut, const Count* prev, Count* out, std::size_t n, std::size_t bins, Count* carry) noexcept;
+
+    /**
+     * Histogram of a rectangle from the counters at its four corners:
+     * hist[b] = br[b] - tr[b] - bl[b] + tl[b] in Count arithmetic, widened to u32.
+     */
+    void (*rectHistogram)(const Count* br, const Count* tr, const Count* bl, const Count* tl, u32* hist, std::size_t bins) noexcept;
+};
+
+/** Histogram kernels for a given level, or nullptr if the CPU cannot run them. */
+template<class Count>
+const HistogramKernels<Count>* histogramKernels(SimdLevel level) noexcept;
+
+/** Histogram kernels for simdLevel(); resolved once per process. */
+template<class Count>
+const HistogramKernels<Count>& histogramKernels() noexcept;
+
+/** Multi-channel row kernels over interleaved u8 samples (see computeIntegralInterleaved); Acc is u32 or u64. */
+template<class Acc>
+struct ChannelKernels {
+    /**
+     * One interleaved table row of a `channels`-channel image (1..4):
+     * out[x*channels + k] = in[k] + in[channels + k] + ... + in[x*channels + k] (+ prev[x*channels + k]).
+     */
+    void (*interleavedRow)(const u8* in, const Acc* prev, Acc* out, std::size_t n, unsigned channels) noexcept;
+
+    /** Same sums written to one row per channel: out[k][x]; prev is nullptr or one row per channel. */
+    void (*planarRow)(const u8* in, const Acc* const* prev, Acc* const* out, std::size_t n, unsigned channels) noexcept;
+};
+
+/** Channel kernels for a given level, or nullptr if the CPU cannot run them. */
+template<class Acc>
+const ChannelKernels<Acc>* channelKernels(SimdLevel level) noexcept;
+
+/** Channel kernels for simdLevel(); resolved once per process. */
+template<class Acc>
+const ChannelKernels<Acc>& channelKernels() noexcept;
+
+/** Pixel type of a squared image: wide enough for the square of any pixel. */
+template<class Pixel> struct SquaredPixel;
+template<> struct SquaredPixel<u8> { using type = u16; };
+template<> struct SquaredPixel<u16> { using type = u32; };
+template<> struct SquaredPixel<float> { using type = double; };
+
+/** out[i] = in[i]^2 for i < n (squared-sum tables feed these to the SIMD kernels). */
+template<class Pixel, class SqPixel>
+inline void squarePixels(const Pixel* in, SqPixel* out, std::size_t n) noexcept{
+    for(std::size_t i=0;i<n;++i) out[i] = static_cast<SqPixel>(static_cast<SqPixel>(in[i]) * static_cast<SqPixel>(in[i]));
+}
+
+/** Kernels for a given level, or nullptr if the CPU cannot run them. */
+template<class Pixel, class Acc>
+const IntegralKernels<Pixel, Acc>* integralKernels(SimdLevel level) noexcept;
+
+/** Kernels for simdLevel(); resolved once per process. */
+template<class Pixel, class Acc>
+const IntegralKernels<Pixel, Acc>& integralKernels() noexcept;
+
+#endif // INTEGRAL_KERNELS_HPP
@@ -0,0 +1,165 @@
+// integral_loops.inl
+// Kernels written as plain loops for the compiler to vectorise. integral_simd.cpp
+// includes this file in the scalar namespace and, through integral_simd.inl, in
+// every ISA namespace, so each copy is auto-vectorised for exactly one
+// instruction set.
+
+// Diagonal state update of the tilted integral (see IntegralKernels::tiltedRow).
+template<class Acc>
+static void tiltedStep(const Acc* prefix, Acc* right, Acc* left, Acc* out, size_t n) noexcept{
+    for(size_t x=0;x+1<n;++x) right[x] = prefix[x] + right[x+1];
+    right[n-1] += prefix[n-1];
+    for(size_t x=n-1;x>0;--x) left[x] = left[x-1] + prefix[x-1];
+    left[0] = 0;
+    if(out) for(size_t x=0;x<n;++x) out[x] = right[x] - left[x];
+}
+
+// Window mean as a Pixel: rounded to nearest for integer pixels.
+template<class Pixel>
+static inline Pixel boxMean(double v) noexcept{
+    if constexpr (std::is_floating_point<Pixel>::value) return static_cast<Pixel>(v);
+    else return static_cast<Pixel>(v + 0.5);
+}
+
+// Box filter output row (see IntegralKernels::boxRow).
+template<class Pixel, class Acc>
+static void boxRow(const Acc* prefix, Pixel* out, size_t n, size_t r, size_t rows) noexcept{
+    auto scale = [rows](size_t cols){ return 1.0 / static_cast<double>(cols*rows); };
+    size_t x = 0;
+    // windows clipped on the left (and possibly on the right)
+    for(;x<n && x<=r;++x){
+        size_t hi = std::min(x + r, n - 1);
+        out[x] = boxMean<Pixel>(static_cast<double>(prefix[hi]) * scale(hi + 1));
+    }
+    // full windows: one subtraction and one multiply per pixel
+    const double inv = scale(2*r + 1);
+    for(;x+r<n;++x) out[x] = boxMean<Pixel>(static_cast<double>(static_cast<Acc>(prefix[x+r] - prefix[x-r-1])) * inv);
+    // windows clipped on the right
+    for(;x<n;++x) out[x] = boxMean<Pixel>(static_cast<double>(static_cast<Acc>(prefix[n-1] - prefix[x-r-1])) * scale(n + r - x));
+}
+
+// Local threshold of one pixel from its window sum, squared sum and size.
+template<class Pixel>
+static inline u8 thresholdPixel(Pixel v, double sum, double sq, double n, const ThresholdParams& p) noexcept{
+    double mean = sum / n, t;
+    if(p.method == ThresholdMethod::Bradley){
+        t = mean*(1.0 - p.k);
+    }else{
+        double sd = std::sqrt(std::max(sq / n - mean*mean, 0.0));
+        t = mean*(1.0 + p.k*(sd/p.R - 1.0));
+    }
+    return static_cast<double>(v) > t ? 255 : 0;
+}
+
+// Adaptive threshold output row (see IntegralKernels::thresholdRow).
+template<class Pixel, class Acc>
+static void thresholdRow(const Pixel* in, const Acc* prefix, const u64* prefixSq, u8* out, size_t n, size_t rows, const ThresholdParams& p) noexcept{
+    const size_t r = p.radius;
+    const bool sauvola = p.method == ThresholdMethod::Sauvola;
+    // clipped window over columns (lo, hi]; lo == SIZE_MAX starts at column 0,
+    // and hi - lo still counts the columns in wrapping arithmetic
+    auto window = [&](size_t x, size_t lo, size_t hi){
+        double sum = static_cast<double>(static_cast<Acc>(prefix[hi] - (lo != SIZE_MAX ? prefix[lo] : Acc(0))));
+        double sq = sauvola ? static_cast<double>(prefixSq[hi] - (lo != SIZE_MAX ? prefixSq[lo] : u64(0))) : 0.0;
+        out[x] = thresholdPixel(in[x], sum, sq, static_cast<double>((hi - lo)*rows), p);
+    };
+    size_t x = 0;
+    for(;x<n && x<=r;++x) window(x, SIZE_MAX, std::min(x + r, n - 1));
+    // full windows, split by rule so the loops have no branches
+    const double full = static_cast<double>((2*r + 1)*rows);
+    if(sauvola){
+        for(;x+r<n;++x) out[x] = thresholdPixel(in[x], static_cast<double>(static_cast<Acc>(prefix[x+r] - prefix[x-r-1])),
+                                                static_cast<double>(prefixSq[x+r] - prefixSq[x-r-1]), full, p);
+    }else{
+        for(;x+r<n;++x) out[x] = thresholdPixel(in[x], static_cast<double>(static_cast<Acc>(prefix[x+r] - prefix[x-r-1])), 0.0, full, p);
+    }
+    for(;x<n;++x) window(x, x - r - 1, n - 1);
+}
+
+// Column sums of a pixel change (see IntegralKernels::deltaColumns); unsigned
+// accumulators wrap, which cancels once the change is added to the table.
+template<class Pixel, class Acc>
+static void deltaColumns(const Pixel* cur, const Pixel* old, Acc* acc, size_t n) noexcept{
+    for(size_t i=0;i<n;++i) acc[i] += static_cast<Acc>(static_cast<Acc>(cur[i]) - static_cast<Acc>(old[i]));
+}
+
+// Integral histogram row (see HistogramKernels::histogramRow); the inner loop
+// over the bins is what vectorises.
+template<class Count>
+static void histogramRow(const u8* in, const u8* lut, const Count* prev, Count* out, size_t n, size_t bins, Count* carry) noexcept{
+    if(prev){
+        for(size_t x=0;x<n;++x, prev+=bins, out+=bins){
+            ++carry[lut[in[x]]];
+            for(size_t b=0;b<bins;++b) out[b] = static_cast<Count>(prev[b] + carry[b]);
+        }
+    }else{
+        for(size_t x=0;x<n;++x, out+=bins){
+            ++carry[lut[in[x]]];
+            std::copy(carry, carry + bins, out);
+        }
+    }
+}
+
+// Rectangle histogram from four corner runs (see HistogramKernels::rectHistogram).
+template<class Count>
+static void rectHistogram(const Count* br, const Count* tr, const Count* bl, const Count* tl, u32* hist, size_t bins) noexcept{
+    for(size_t b=0;b<bins;++b) hist[b] = static_cast<Count>(br[b] - tr[b] - bl[b] + tl[b]);
+}
+
+template<class Count>
+static const HistogramKernels<Count>* histogramTable() noexcept{
+    static const HistogramKernels<Count> kernels = {histogramRow<Count>, rectHistogram<Count>};
+    return &kernels;
+}
+
+// Interleaved rows with the channel count fixed, so the per-channel carries
+// stay in registers and the channel loop is unrolled (and SLP-vectorised for
+// four channels).
+template<class Acc, unsigned C, bool HasPrev>
+static void interleavedRowC(const u8* in, const Acc* prev, Acc* out, size_t n) noexcept{
+    Acc carry[C] = {};
+    for(size_t x=0;x<n;++x, in+=C, out+=C){
+        for(unsigned k=0;k<C;++k){
+            carry[k] += in[k];
+            out[k] = HasPrev ? static_cast<Acc>(carry[k] + prev[x*C + k]) : carry[k];
+        }
+    }
+}
+
+template<class Acc, unsigned C>
+static void planarRowC(const u8* in, const Acc* const* prev, Acc* const* out, size_t n) noexcept{
+    Acc carry[C] = {};
+    for(size_t x=0;x<n;++x, in+=C){
+        for(unsigned k=0;k<C;++k){
+            carry[k] += in[k];
+            out[k][x] = prev ? static_cast<Acc>(carry[k] + prev[k][x]) : carry[k];
+        }
+    }
+}
+
+// Multi-channel rows (see ChannelKernels).
+template<class Acc>
+static void interleavedRow(const u8* in, const Acc* prev, Acc* out, size_t n, unsigned channels) noexcept{
+    switch(channels){
+        case 1: return prev ? interleavedRowC<Acc, 1, true>(in, prev, out, n) : interleavedRowC<Acc, 1, false>(in, prev, out, n);
+        case 2: return prev ? interleavedRowC<Acc, 2, true>(in, prev, out, n) : interleavedRowC<Acc, 2, false>(in, prev, out, n);
+        case 3: return prev ? interleavedRowC<Acc, 3, true>(in, prev, out, n) : interleavedRowC<Acc, 3, false>(in, prev, out, n);
+        default: return prev ? interleavedRowC<Acc, 4, true>(in, prev, out, n) : interleavedRowC<Acc, 4, false>(in, prev, out, n);
+    }
+}
+
+template<class Acc>
+static void planarRow(const u8* in, const Acc* const* prev, Acc* const* out, size_t n, unsigned channels) noexcept{
+    switch(channels){
+        case 1: return planarRowC<Acc, 1>(in, prev, out, n);
+        case 2: return planarRowC<Acc, 2>(in, prev, out, n);
+        case 3: return planarRowC<Acc, 3>(in, prev, out, n);
+        default: return planarRowC<Acc, 4>(in, prev, out, n);
+    }
+}
+
+template<class Acc>
+static const ChannelKernels<Acc>* channelTable() noexcept{
+    static const ChannelKernels<Acc> kernels = {interleavedRow<Acc>, planarRow<Acc>};
+    return &kernels;
+}
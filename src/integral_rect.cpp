@@ -0,0 +1,56 @@
+// integral_rect.cpp
+// Batched rectangle-sum queries (computeRectSums) over integral tables, on the
+// gather kernels of integral_simd.cpp and the IntegralEngine pool.
+
+#include "integral.hpp"
+#include "integral_kernels.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+using std::size_t;
+
+// Rectangles per task: enough to amortise handing out a task, and a multiple
+// of every gather width.
+static constexpr size_t kRectChunk = 16384;
+
+template<class Acc>
+void IntegralEngine::rectSums(ImageView<Acc> integral, const RectQuery& rects, Acc* sums, int num_threads, IntegralLayout layout) noexcept{
+    if(rects.count == 0) return;
+    if(num_threads < 1 || num_threads > pool_->size()) num_threads = pool_->size();
+    const RectKernels<Acc>& k = rectKernels<Acc>();
+    const auto kernel = layout == IntegralLayout::ZeroPadded ? k.paddedRectSums : k.rectSums;
+    const size_t stride = integral.stride / sizeof(Acc);
+
+    // one chunk per thread, rounded up to whole kRectChunk blocks
+    size_t per = (rects.count + static_cast<size_t>(num_threads) - 1) / static_cast<size_t>(num_threads);
+    per = (per + kRectChunk - 1) / kRectChunk * kRectChunk;
+    size_t tasks = (rects.count + per - 1) / per;
+    pool_->run(tasks, [&](size_t t){
+        size_t i = t*per;
+        size_t n = std::min(per, rects.count - i);
+        kernel(integral.data, stride, rects.x0 + i, rects.y0 + i, rects.x1 + i, rects.y1 + i, sums + i, n);
+    });
+}
+
+template<class Acc>
+void computeRectSums(ImageView<Acc> integral, const RectQuery& rects, Acc* sums, int num_threads, IntegralLayout layout) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->rectSums(integral, rects, sums, num_threads, layout);
+}
+
+template<class Acc>
+void computeRectSums(const std::vector<Acc>& integral, std::size_t w, std::size_t h, const RectQuery& rects, std::vector<Acc>& sums, int num_threads) noexcept{
+    sums.resize(rects.count);
+    computeRectSums(ImageView<Acc>(integral, w, h), rects, sums.data(), num_threads);
+}
+
+#define INTEGRAL_INSTANTIATE_RECT(Acc) \
+    template void IntegralEngine::rectSums<Acc>(ImageView<Acc>, const RectQuery&, Acc*, int, IntegralLayout) noexcept; \
+    template void computeRectSums<Acc>(ImageView<Acc>, const RectQuery&, Acc*, int, IntegralLayout) noexcept; \
+    template void computeRectSums<Acc>(const std::vector<Acc>&, std::size_t, std::size_t, const RectQuery&, std::vector<Acc>&, int) noexcept;
+INTEGRAL_INSTANTIATE_RECT(u32)
+INTEGRAL_INSTANTIATE_RECT(u64)
+INTEGRAL_INSTANTIATE_RECT(double)
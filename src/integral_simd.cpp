@@ -0,0 +1,621 @@
+// integral_simd.cpp
+// Scalar and SIMD (SSE4.1 / AVX2 / AVX-512) row and column kernels with runtime dispatch.
+// Each instruction set is compiled under its own #pragma GCC target region, so
+// the translation unit itself needs no -m flags and the binary runs on any x86-64.
+// The vector kernel bodies are shared (integral_simd.inl, integral_loops.inl for
+// the auto-vectorised ones, and integral_gather.inl for the AVX2 / AVX-512
+// rectangle queries); only the per-ISA Lanes<Pixel, Acc> and RectLanes<Acc>
+// primitives below differ.
+
+#include "integral_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define INTEGRAL_X86 1
+#endif
+
+using std::size_t;
+
+template<class Pixel, class Acc, bool HasPrev>
+static Acc rowPrefixScalar(const Pixel* in, const Acc* prev, Acc* out, size_t n, Acc carry) noexcept{
+    for(size_t x=0;x<n;++x){
+        carry += static_cast<Acc>(in[x]);
+        out[x] = HasPrev ? prev[x] + carry : carry;
+    }
+    return carry;
+}
+
+template<class Pixel, class Acc>
+static void columnSumScalar(const Pixel* in, Acc* acc, size_t n) noexcept{
+    for(size_t x=0;x<n;++x) acc[x] += static_cast<Acc>(in[x]);
+}
+
+template<class Pixel, class Acc>
+static Acc rowSumScalar(const Pixel* in, size_t n) noexcept{
+    Acc s = 0;
+    for(size_t x=0;x<n;++x) s += static_cast<Acc>(in[x]);
+    return s;
+}
+
+// Four-corner rectangle sums (see RectKernels); also the tail of the gather kernels.
+template<class Acc>
+static void rectSumsScalar(const Acc* table, size_t stride, const u32* x0, const u32* y0, const u32* x1, const u32* y1, Acc* out, size_t n) noexcept{
+    for(size_t i=0;i<n;++i){
+        Acc a = table[y1[i]*stride + x1[i]];
+        Acc b = y0[i] ? table[(y0[i]-1)*stride + x1[i]] : Acc(0);
+        Acc c = x0[i] ? table[y1[i]*stride + (x0[i]-1)] : Acc(0);
+        Acc d = (x0[i] && y0[i]) ? table[(y0[i]-1)*stride + (x0[i]-1)] : Acc(0);
+        out[i] = a - b - c + d;
+    }
+}
+
+template<class Acc>
+static void paddedRectSumsScalar(const Acc* table, size_t stride, const u32* x0, const u32* y0, const u32* x1, const u32* y1, Acc* out, size_t n) noexcept{
+    for(size_t i=0;i<n;++i){
+        const Acc* top = table + y0[i]*stride;
+        const Acc* bottom = table + (y1[i] + size_t(1))*stride;
+        out[i] = bottom[x1[i] + size_t(1)] - top[x1[i] + size_t(1)] - bottom[x0[i]] + top[x0[i]];
+    }
+}
+
+namespace scalar {
+
+#include "integral_loops.inl"
+
+template<class Pixel, class Acc>
+static Acc rowPrefix(const Pixel* in, const Acc* prev, Acc* out, size_t n, Acc carry) noexcept{
+    return prev ? rowPrefixScalar<Pixel, Acc, true>(in, prev, out, n, carry) : rowPrefixScalar<Pixel, Acc, false>(in, prev, out, n, carry);
+}
+
+template<class Pixel, class Acc>
+static void tiltedRow(const Pixel* in, Acc* prefix, Acc* right, Acc* left, Acc* out, size_t n) noexcept{
+    rowPrefixScalar<Pixel, Acc, false>(in, nullptr, prefix, n, 0);
+    tiltedStep(prefix, right, left, out, n);
+}
+
+template<class Pixel, class Acc>
+static const IntegralKernels<Pixel, Acc>* table() noexcept{
+    static const IntegralKernels<Pixel, Acc> kernels = {rowPrefix<Pixel, Acc>, columnSumScalar<Pixel, Acc>, rowSumScalar<Pixel, Acc>, tiltedRow<Pixel, Acc>, boxRow<Pixel, Acc>, thresholdRow<Pixel, Acc>, deltaColumns<Pixel, Acc>};
+    return &kernels;
+}
+
+template<class Acc>
+static const RectKernels<Acc>* rectTable() noexcept{
+    static const RectKernels<Acc> kernels = {rectSumsScalar<Acc>, paddedRectSumsScalar<Acc>};
+    return &kernels;
+}
+
+} // namespace scalar
+
+#ifdef INTEGRAL_X86
+
+// Unaligned load of the low 32 bits of a vector (2 u16 or 4 u8 pixels).
+static inline __m128i loadLow32(const void* p) noexcept{
+    int v;
+    std::memcpy(&v, p, sizeof v);
+    return _mm_cvtsi32_si128(v);
+}
+
+// Unaligned load of the low 16 bits of a vector (2 u8 pixels).
+static inline __m128i loadLow16(const void* p) noexcept{
+    std::uint16_t v;
+    std::memcpy(&v, p, sizeof v);
+    return _mm_cvtsi32_si128(v);
+}
+
+// GCC 12 reports the self-initialised placeholders inside the intrinsic
+// headers as uninitialised when they are compiled through a target pragma.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// ---- SSE4.1: 128-bit vectors ----
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+namespace sse41 {
+
+struct U64x2 {
+    using V = __m128i;
+    static constexpr size_t N = 2;
+    static V loadAcc(const u64* p) noexcept{ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static void store(u64* p, V v) noexcept{ _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    static V set1(u64 c) noexcept{ return _mm_set1_epi64x(static_cast<long long>(c)); }
+    static V add(V a, V b) noexcept{ return _mm_add_epi64(a, b); }
+    static V scan(V v) noexcept{ return _mm_add_epi64(v, _mm_slli_si128(v, 8)); }
+    static V last(V v) noexcept{ return _mm_unpackhi_epi64(v, v); }
+    static u64 first(V v) noexcept{ return static_cast<u64>(_mm_cvtsi128_si64(v)); }
+    static u64 reduce(V v) noexcept{ return first(add(v, last(v))); }
+};
+
+struct U32x4 {
+    using V = __m128i;
+    static constexpr size_t N = 4;
+    static V loadAcc(const u32* p) noexcept{ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static void store(u32* p, V v) noexcept{ _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    static V set1(u32 c) noexcept{ return _mm_set1_epi32(static_cast<int>(c)); }
+    static V add(V a, V b) noexcept{ return _mm_add_epi32(a, b); }
+    static V scan(V v) noexcept{
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+        return _mm_add_epi32(v, _mm_slli_si128(v, 8));
+    }
+    static V last(V v) noexcept{ return _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,3)); }
+    static u32 first(V v) noexcept{ return static_cast<u32>(_mm_cvtsi128_si32(v)); }
+    static u32 reduce(V v) noexcept{ return first(last(scan(v))); }
+};
+
+struct F64x2 {
+    using V = __m128d;
+    static constexpr size_t N = 2;
+    static V loadAcc(const double* p) noexcept{ return _mm_loadu_pd(p); }
+    static void store(double* p, V v) noexcept{ _mm_storeu_pd(p, v); }
+    static V set1(double c) noexcept{ return _mm_set1_pd(c); }
+    static V add(V a, V b) noexcept{ return _mm_add_pd(a, b); }
+    static V scan(V v) noexcept{ return _mm_add_pd(v, _mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(v), 8))); }
+    static V last(V v) noexcept{ return _mm_unpackhi_pd(v, v); }
+    static double first(V v) noexcept{ return _mm_cvtsd_f64(v); }
+    static double reduce(V v) noexcept{ return first(add(v, last(v))); }
+};
+
+template<class Pixel, class Acc> struct Lanes;
+template<> struct Lanes<u8, u32> : U32x4 {
+    static V load(const u8* p) noexcept{ return _mm_cvtepu8_epi32(loadLow32(p)); }
+};
+template<> struct Lanes<u16, u32> : U32x4 {
+    static V load(const u16* p) noexcept{ return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+};
+template<> struct Lanes<u32, u32> : U32x4 {
+    static V load(const u32* p) noexcept{ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+};
+template<> struct Lanes<u8, u64> : U64x2 {
+    static V load(const u8* p) noexcept{ return _mm_cvtepu8_epi64(loadLow16(p)); }
+};
+template<> struct Lanes<u16, u64> : U64x2 {
+    static V load(const u16* p) noexcept{ return _mm_cvtepu16_epi64(loadLow32(p)); }
+};
+template<> struct Lanes<u32, u64> : U64x2 {
+    static V load(const u32* p) noexcept{ return _mm_cvtepu32_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+};
+template<> struct Lanes<u64, u64> : U64x2 {
+    static V load(const u64* p) noexcept{ return loadAcc(p); }
+};
+template<> struct Lanes<float, double> : F64x2 {
+    static V load(const float* p) noexcept{ return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)))); }
+};
+template<> struct Lanes<double, double> : F64x2 {
+    static V load(const double* p) noexcept{ return loadAcc(p); }
+};
+
+#include "integral_simd.inl"
+
+} // namespace sse41
+#pragma GCC pop_options
+
+// ---- AVX2: 256-bit vectors ----
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace avx2 {
+
+struct U64x4 {
+    using V = __m256i;
+    static constexpr size_t N = 4;
+    static V loadAcc(const u64* p) noexcept{ return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static void store(u64* p, V v) noexcept{ _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    static V set1(u64 c) noexcept{ return _mm256_set1_epi64x(static_cast<long long>(c)); }
+    static V add(V a, V b) noexcept{ return _mm256_add_epi64(a, b); }
+    static V scan(V v) noexcept{
+        const __m256i zero = _mm256_setzero_si256();
+        v = _mm256_add_epi64(v, _mm256_blend_epi32(_mm256_permute4x64_epi64(v, _MM_SHUFFLE(2,1,0,0)), zero, 0x03));
+        return _mm256_add_epi64(v, _mm256_blend_epi32(_mm256_permute4x64_epi64(v, _MM_SHUFFLE(1,0,0,0)), zero, 0x0F));
+    }
+    static V last(V v) noexcept{ return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3,3,3,3)); }
+    static u64 first(V v) noexcept{ return static_cast<u64>(_mm_cvtsi128_si64(_mm256_castsi256_si128(v))); }
+    static u64 reduce(V v) noexcept{ return first(last(scan(v))); }
+};
+
+struct U32x8 {
+    using V = __m256i;
+    static constexpr size_t N = 8;
+    static V loadAcc(const u32* p) noexcept{ return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static void store(u32* p, V v) noexcept{ _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    static V set1(u32 c) noexcept{ return _mm256_set1_epi32(static_cast<int>(c)); }
+    static V add(V a, V b) noexcept{ return _mm256_add_epi32(a, b); }
+    static V scan(V v) noexcept{
+        // scan each 128-bit half, then add the low half's total to the high half
+        v = _mm256_add_epi32(v, _mm256_slli_si256(v, 4));
+        v = _mm256_add_epi32(v, _mm256_slli_si256(v, 8));
+        __m256i lo = _mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(3));
+        return _mm256_add_epi32(v, _mm256_blend_epi32(_mm256_setzero_si256(), lo, 0xF0));
+    }
+    static V last(V v) noexcept{ return _mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(7)); }
+    static u32 first(V v) noexcept{ return static_cast<u32>(_mm_cvtsi128_si32(_mm256_castsi256_si128(v))); }
+    static u32 reduce(V v) noexcept{ return first(last(scan(v))); }
+};
+
+struct F64x4 {
+    using V = __m256d;
+    static constexpr size_t N = 4;
+    static V loadAcc(const double* p) noexcept{ return _mm256_loadu_pd(p); }
+    static void store(double* p, V v) noexcept{ _mm256_storeu_pd(p, v); }
+    static V set1(double c) noexcept{ return _mm256_set1_pd(c); }
+    static V add(V a, V b) noexcept{ return _mm256_add_pd(a, b); }
+    static V scan(V v) noexcept{
+        const __m256d zero = _mm256_setzero_pd();
+        v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(2,1,0,0)), zero, 0x1));
+        return _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(1,0,0,0)), zero, 0x3));
+    }
+    static V last(V v) noexcept{ return _mm256_permute4x64_pd(v, _MM_SHUFFLE(3,3,3,3)); }
+    static double first(V v) noexcept{ return _mm_cvtsd_f64(_mm256_castpd256_pd128(v)); }
+    static double reduce(V v) noexcept{ return first(last(scan(v))); }
+};
+
+template<class Pixel, class Acc> struct Lanes;
+template<> struct Lanes<u8, u32> : U32x8 {
+    static V load(const u8* p) noexcept{ return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+};
+template<> struct Lanes<u16, u32> : U32x8 {
+    static V load(const u16* p) noexcept{ return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+};
+template<> struct Lanes<u32, u32> : U32x8 {
+    static V load(const u32* p) noexcept{ return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+};
+template<> struct Lanes<u8, u64> : U64x4 {
+    static V load(const u8* p) noexcept{ return _mm256_cvtepu8_epi64(loadLow32(p)); }
+};
+template<> struct Lanes<u16, u64> : U64x4 {
+    static V load(const u16* p) noexcept{ return _mm256_cvtepu16_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+};
+template<> struct Lanes<u32, u64> : U64x4 {
+    static V load(const u32* p) noexcept{ return _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+};
+template<> struct Lanes<u64, u64> : U64x4 {
+    static V load(const u64* p) noexcept{ return loadAcc(p); }
+};
+template<> struct Lanes<float, double> : F64x4 {
+    static V load(const float* p) noexcept{ return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+};
+template<> struct Lanes<double, double> : F64x4 {
+    static V load(const double* p) noexcept{ return loadAcc(p); }
+};
+
+#include "integral_simd.inl"
+
+// Rectangle queries: four rectangles per step, corner offsets in 64-bit lanes.
+struct RectIdx4 {
+    using Idx = __m256i;
+    using Mask = __m256i;
+    static constexpr size_t N = 4;
+    static Idx loadCoord(const u32* p) noexcept{ return _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+    static Idx set1(size_t c) noexcept{ return _mm256_set1_epi64x(static_cast<long long>(c)); }
+    static Idx add(Idx a, Idx b) noexcept{ return _mm256_add_epi64(a, b); }
+    static Idx sub(Idx a, Idx b) noexcept{ return _mm256_sub_epi64(a, b); }
+    static Idx mulStride(Idx y, Idx s) noexcept{ return _mm256_mul_epu32(y, s); }
+    static Mask nonzero(Idx v) noexcept{ return _mm256_xor_si256(_mm256_cmpeq_epi64(v, _mm256_setzero_si256()), _mm256_set1_epi64x(-1)); }
+    static Mask both(Mask a, Mask b) noexcept{ return _mm256_and_si256(a, b); }
+};
+
+template<class Acc> struct RectLanes;
+template<> struct RectLanes<u64> : RectIdx4 {
+    using V = __m256i;
+    static V gather(const u64* t, Idx i) noexcept{ return _mm256_i64gather_epi64(reinterpret_cast<const long long*>(t), i, 8); }
+    static V maskGather(const u64* t, Idx i, Mask m) noexcept{ return _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), reinterpret_cast<const long long*>(t), i, m, 8); }
+    static V combine(V a, V b, V c, V d) noexcept{ return _mm256_add_epi64(_mm256_sub_epi64(_mm256_sub_epi64(a, b), c), d); }
+    static void store(u64* p, V v) noexcept{ _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+};
+template<> struct RectLanes<u32> : RectIdx4 {
+    using V = __m128i;
+    // 64-bit lane mask -> 32-bit lane mask of the narrow gather
+    static __m128i narrow(Mask m) noexcept{ return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(m, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6))); }
+    static V gather(const u32* t, Idx i) noexcept{ return _mm256_i64gather_epi32(reinterpret_cast<const int*>(t), i, 4); }
+    static V maskGather(const u32* t, Idx i, Mask m) noexcept{ return _mm256_mask_i64gather_epi32(_mm_setzero_si128(), reinterpret_cast<const int*>(t), i, narrow(m), 4); }
+    static V combine(V a, V b, V c, V d) noexcept{ return _mm_add_epi32(_mm_sub_epi32(_mm_sub_epi32(a, b), c), d); }
+    static void store(u32* p, V v) noexcept{ _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+};
+template<> struct RectLanes<double> : RectIdx4 {
+    using V = __m256d;
+    static V gather(const double* t, Idx i) noexcept{ return _mm256_i64gather_pd(t, i, 8); }
+    static V maskGather(const double* t, Idx i, Mask m) noexcept{ return _mm256_mask_i64gather_pd(_mm256_setzero_pd(), t, i, _mm256_castsi256_pd(m), 8); }
+    static V combine(V a, V b, V c, V d) noexcept{ return _mm256_add_pd(_mm256_sub_pd(_mm256_sub_pd(a, b), c), d); }
+    static void store(double* p, V v) noexcept{ _mm256_storeu_pd(p, v); }
+};
+
+#include "integral_gather.inl"
+
+} // namespace avx2
+#pragma GCC pop_options
+
+// ---- AVX-512: 512-bit vectors ----
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace avx512 {
+
+struct U64x8 {
+    using V = __m512i;
+    static constexpr size_t N = 8;
+    static V loadAcc(const u64* p) noexcept{ return _mm512_loadu_si512(p); }
+    static void store(u64* p, V v) noexcept{ _mm512_storeu_si512(p, v); }
+    static V set1(u64 c) noexcept{ return _mm512_set1_epi64(static_cast<long long>(c)); }
+    static V add(V a, V b) noexcept{ return _mm512_add_epi64(a, b); }
+    static V scan(V v) noexcept{
+        const __m512i zero = _mm512_setzero_si512();
+        v = _mm512_add_epi64(v, _mm512_alignr_epi64(v, zero, 7));
+        v = _mm512_add_epi64(v, _mm512_alignr_epi64(v, zero, 6));
+        return _mm512_add_epi64(v, _mm512_alignr_epi64(v, zero, 4));
+    }
+    static V last(V v) noexcept{ return _mm512_permutexvar_epi64(_mm512_set1_epi64(7), v); }
+    static u64 first(V v) noexcept{ return static_cast<u64>(_mm_cvtsi128_si64(_mm512_castsi512_si128(v))); }
+    static u64 reduce(V v) noexcept{ return static_cast<u64>(_mm512_reduce_add_epi64(v)); }
+};
+
+struct U32x16 {
+    using V = __m512i;
+    static constexpr size_t N = 16;
+    static V loadAcc(const u32* p) noexcept{ return _mm512_loadu_si512(p); }
+    static void store(u32* p, V v) noexcept{ _mm512_storeu_si512(p, v); }
+    static V set1(u32 c) noexcept{ return _mm512_set1_epi32(static_cast<int>(c)); }
+    static V add(V a, V b) noexcept{ return _mm512_add_epi32(a, b); }
+    static V scan(V v) noexcept{
+        const __m512i zero = _mm512_setzero_si512();
+        v = _mm512_add_epi32(v, _mm512_alignr_epi32(v, zero, 15));
+        v = _mm512_add_epi32(v, _mm512_alignr_epi32(v, zero, 14));
+        v = _mm512_add_epi32(v, _mm512_alignr_epi32(v, zero, 12));
+        return _mm512_add_epi32(v, _mm512_alignr_epi32(v, zero, 8));
+    }
+    static V last(V v) noexcept{ return _mm512_permutexvar_epi32(_mm512_set1_epi32(15), v); }
+    static u32 first(V v) noexcept{ return static_cast<u32>(_mm_cvtsi128_si32(_mm512_castsi512_si128(v))); }
+    static u32 reduce(V v) noexcept{ return static_cast<u32>(_mm512_reduce_add_epi32(v)); }
+};
+
+struct F64x8 {
+    using V = __m512d;
+    static constexpr size_t N = 8;
+    static V loadAcc(const double* p) noexcept{ return _mm512_loadu_pd(p); }
+    static void store(double* p, V v) noexcept{ _mm512_storeu_pd(p, v); }
+    static V set1(double c) noexcept{ return _mm512_set1_pd(c); }
+    static V add(V a, V b) noexcept{ return _mm512_add_pd(a, b); }
+    static V scan(V v) noexcept{
+        const __m512i zero = _mm512_setzero_si512();
+        __m512i i = _mm512_castpd_si512(v);
+        v = _mm512_add_pd(v, _mm512_castsi512_pd(_mm512_alignr_epi64(i, zero, 7)));
+        i = _mm512_castpd_si512(v);
+        v = _mm512_add_pd(v, _mm512_castsi512_pd(_mm512_alignr_epi64(i, zero, 6)));
+        i = _mm512_castpd_si512(v);
+        return _mm512_add_pd(v, _mm512_castsi512_pd(_mm512_alignr_epi64(i, zero, 4)));
+    }
+    static V last(V v) noexcept{ return _mm512_permutexvar_pd(_mm512_set1_epi64(7), v); }
+    static double first(V v) noexcept{ return _mm_cvtsd_f64(_mm512_castpd512_pd128(v)); }
+    static double reduce(V v) noexcept{ return _mm512_reduce_add_pd(v); }
+};
+
+template<class Pixel, class Acc> struct Lanes;
+template<> struct Lanes<u8, u32> : U32x16 {
+    static V load(const u8* p) noexcept{ return _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+};
+template<> struct Lanes<u16, u32> : U32x16 {
+    static V load(const u16* p) noexcept{ return _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))); }
+};
+template<> struct Lanes<u32, u32> : U32x16 {
+    static V load(const u32* p) noexcept{ return _mm512_loadu_si512(p); }
+};
+template<> struct Lanes<u8, u64> : U64x8 {
+    static V load(const u8* p) noexcept{ return _mm512_cvtepu8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+};
+template<> struct Lanes<u16, u64> : U64x8 {
+    static V load(const u16* p) noexcept{ return _mm512_cvtepu16_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+};
+template<> struct Lanes<u32, u64> : U64x8 {
+    static V load(const u32* p) noexcept{ return _mm512_cvtepu32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))); }
+};
+template<> struct Lanes<u64, u64> : U64x8 {
+    static V load(const u64* p) noexcept{ return loadAcc(p); }
+};
+template<> struct Lanes<float, double> : F64x8 {
+    static V load(const float* p) noexcept{ return _mm512_cvtps_pd(_mm256_loadu_ps(p)); }
+};
+template<> struct Lanes<double, double> : F64x8 {
+    static V load(const double* p) noexcept{ return loadAcc(p); }
+};
+
+#include "integral_simd.inl"
+
+// Rectangle queries: eight rectangles per step, border lanes masked in k registers.
+struct RectIdx8 {
+    using Idx = __m512i;
+    using Mask = __mmask8;
+    static constexpr size_t N = 8;
+    static Idx loadCoord(const u32* p) noexcept{ return _mm512_cvtepu32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))); }
+    static Idx set1(size_t c) noexcept{ return _mm512_set1_epi64(static_cast<long long>(c)); }
+    static Idx add(Idx a, Idx b) noexcept{ return _mm512_add_epi64(a, b); }
+    static Idx sub(Idx a, Idx b) noexcept{ return _mm512_sub_epi64(a, b); }
+    static Idx mulStride(Idx y, Idx s) noexcept{ return _mm512_mul_epu32(y, s); }
+    static Mask nonzero(Idx v) noexcept{ return _mm512_test_epi64_mask(v, v); }
+    static Mask both(Mask a, Mask b) noexcept{ return static_cast<Mask>(a & b); }
+};
+
+template<class Acc> struct RectLanes;
+template<> struct RectLanes<u64> : RectIdx8 {
+    using V = __m512i;
+    static V gather(const u64* t, Idx i) noexcept{ return _mm512_i64gather_epi64(i, t, 8); }
+    static V maskGather(const u64* t, Idx i, Mask m) noexcept{ return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), m, i, t, 8); }
+    static V combine(V a, V b, V c, V d) noexcept{ return _mm512_add_epi64(_mm512_sub_epi64(_mm512_sub_epi64(a, b), c), d); }
+    static void store(u64* p, V v) noexcept{ _mm512_storeu_si512(p, v); }
+};
+template<> struct RectLanes<u32> : RectIdx8 {
+    using V = __m256i;
+    static V gather(const u32* t, Idx i) noexcept{ return _mm512_i64gather_epi32(i, t, 4); }
+    static V maskGather(const u32* t, Idx i, Mask m) noexcept{ return _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), m, i, t, 4); }
+    static V combine(V a, V b, V c, V d) noexcept{ return _mm256_add_epi32(_mm256_sub_epi32(_mm256_sub_epi32(a, b), c), d); }
+    static void store(u32* p, V v) noexcept{ _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+};
+template<> struct RectLanes<double> : RectIdx8 {
+    using V = __m512d;
+    static V gather(const double* t, Idx i) noexcept{ return _mm512_i64gather_pd(i, t, 8); }
+    static V maskGather(const double* t, Idx i, Mask m) noexcept{ return _mm512_mask_i64gather_pd(_mm512_setzero_pd(), m, i, t, 8); }
+    static V combine(V a, V b, V c, V d) noexcept{ return _mm512_add_pd(_mm512_sub_pd(_mm512_sub_pd(a, b), c), d); }
+    static void store(double* p, V v) noexcept{ _mm512_storeu_pd(p, v); }
+};
+
+#include "integral_gather.inl"
+
+} // namespace avx512
+#pragma GCC pop_options
+
+#pragma GCC diagnostic pop
+
+#endif // INTEGRAL_X86
+
+static bool cpuSupports(SimdLevel level) noexcept{
+#ifdef INTEGRAL_X86
+    switch(level){
+        case SimdLevel::Scalar: return true;
+        case SimdLevel::SSE41: return __builtin_cpu_supports("sse4.1");
+        case SimdLevel::AVX2: return __builtin_cpu_supports("avx2");
+        case SimdLevel::AVX512: return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#else
+    return level == SimdLevel::Scalar;
+#endif
+}
+
+static SimdLevel detectSimdLevel() noexcept{
+    SimdLevel cap = SimdLevel::AVX512;
+    if(const char* env = std::getenv("INTEGRAL_SIMD")){
+        for(SimdLevel l: {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512}){
+            if(std::strcmp(env, simdLevelName(l)) == 0) cap = l;
+        }
+    }
+    for(SimdLevel l: {SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE41}){
+        if(l <= cap && cpuSupports(l)) return l;
+    }
+    return SimdLevel::Scalar;
+}
+
+SimdLevel simdLevel() noexcept{
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+const char* simdLevelName(SimdLevel level) noexcept{
+    switch(level){
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE41: return "sse4.1";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+template<class Pixel, class Acc>
+const IntegralKernels<Pixel, Acc>* integralKernels(SimdLevel level) noexcept{
+    if(!cpuSupports(level)) return nullptr;
+    switch(level){
+#ifdef INTEGRAL_X86
+        case SimdLevel::SSE41: return sse41::table<Pixel, Acc>();
+        case SimdLevel::AVX2: return avx2::table<Pixel, Acc>();
+        case SimdLevel::AVX512: return avx512::table<Pixel, Acc>();
+#endif
+        default: return scalar::table<Pixel, Acc>();
+    }
+}
+
+template<class Pixel, class Acc>
+const IntegralKernels<Pixel, Acc>& integralKernels() noexcept{
+    static const IntegralKernels<Pixel, Acc>* kernels = integralKernels<Pixel, Acc>(simdLevel());
+    return *kernels;
+}
+
+template<class Acc>
+const RectKernels<Acc>* rectKernels(SimdLevel level) noexcept{
+    if(!cpuSupports(level)) return nullptr;
+    switch(level){
+#ifdef INTEGRAL_X86
+        case SimdLevel::AVX2: return avx2::rectTable<Acc>();
+        case SimdLevel::AVX512: return avx512::rectTable<Acc>();
+#endif
+        default: return scalar::rectTable<Acc>();
+    }
+}
+
+template<class Acc>
+const RectKernels<Acc>& rectKernels() noexcept{
+    static const RectKernels<Acc>* kernels = rectKernels<Acc>(simdLevel());
+    return *kernels;
+}
+
+template<class Count>
+const HistogramKernels<Count>* histogramKernels(SimdLevel level) noexcept{
+    if(!cpuSupports(level)) return nullptr;
+    switch(level){
+#ifdef INTEGRAL_X86
+        case SimdLevel::SSE41: return sse41::histogramTable<Count>();
+        case SimdLevel::AVX2: return avx2::histogramTable<Count>();
+        case SimdLevel::AVX512: return avx512::histogramTable<Count>();
+#endif
+        default: return scalar::histogramTable<Count>();
+    }
+}
+
+template<class Count>
+const HistogramKernels<Count>& histogramKernels() noexcept{
+    static const HistogramKernels<Count>* kernels = histogramKernels<Count>(simdLevel());
+    return *kernels;
+}
+
+template<class Acc>
+const ChannelKernels<Acc>* channelKernels(SimdLevel level) noexcept{
+    if(!cpuSupports(level)) return nullptr;
+    switch(level){
+#ifdef INTEGRAL_X86
+        case SimdLevel::SSE41: return sse41::channelTable<Acc>();
+        case SimdLevel::AVX2: return avx2::channelTable<Acc>();
+        case SimdLevel::AVX512: return avx512::channelTable<Acc>();
+#endif
+        default: return scalar::channelTable<Acc>();
+    }
+}
+
+template<class Acc>
+const ChannelKernels<Acc>& channelKernels() noexcept{
+    static const ChannelKernels<Acc>* kernels = channelKernels<Acc>(simdLevel());
+    return *kernels;
+}
+
+#define INTEGRAL_INSTANTIATE_RECT_KERNELS(Acc) \
+    template const RectKernels<Acc>* rectKernels<Acc>(SimdLevel) noexcept; \
+    template const RectKernels<Acc>& rectKernels<Acc>() noexcept;
+INTEGRAL_INSTANTIATE_RECT_KERNELS(u32)
+INTEGRAL_INSTANTIATE_RECT_KERNELS(u64)
+INTEGRAL_INSTANTIATE_RECT_KERNELS(double)
+
+#define INTEGRAL_INSTANTIATE_KERNELS(Pixel, Acc) \
+    template const IntegralKernels<Pixel, Acc>* integralKernels<Pixel, Acc>(SimdLevel) noexcept; \
+    template const IntegralKernels<Pixel, Acc>& integralKernels<Pixel, Acc>() noexcept;
+INTEGRAL_INSTANTIATE_KERNELS(u8, u32)
+INTEGRAL_INSTANTIATE_KERNELS(u16, u32)
+INTEGRAL_INSTANTIATE_KERNELS(u32, u32)
+INTEGRAL_INSTANTIATE_KERNELS(u8, u64)
+INTEGRAL_INSTANTIATE_KERNELS(u16, u64)
+INTEGRAL_INSTANTIATE_KERNELS(u32, u64)
+INTEGRAL_INSTANTIATE_KERNELS(float, double)
+INTEGRAL_INSTANTIATE_KERNELS(double, double)
+INTEGRAL_INSTANTIATE_KERNELS(u64, u64)
+
+#define INTEGRAL_INSTANTIATE_HISTOGRAM_KERNELS(Count) \
+    template const HistogramKernels<Count>* histogramKernels<Count>(SimdLevel) noexcept; \
+    template const HistogramKernels<Count>& histogramKernels<Count>() noexcept;
+INTEGRAL_INSTANTIATE_HISTOGRAM_KERNELS(u16)
+INTEGRAL_INSTANTIATE_HISTOGRAM_KERNELS(u32)
+
+#define INTEGRAL_INSTANTIATE_CHANNEL_KERNELS(Acc) \
+    template const ChannelKernels<Acc>* channelKernels<Acc>(SimdLevel) noexcept; \
+    template const ChannelKernels<Acc>& channelKernels<Acc>() noexcept;
+INTEGRAL_INSTANTIATE_CHANNEL_KERNELS(u32)
+INTEGRAL_INSTANTIATE_CHANNEL_KERNELS(u64)
@@ -0,0 +1,66 @@
+// integral_simd.inl
+// Instruction-set independent bodies of the vector kernels. integral_simd.cpp
+// includes this file once per instruction set, inside a namespace that
+// defines Lanes<Pixel, Acc> and under the matching #pragma GCC target, so each
+// copy is compiled for exactly one ISA.
+//
+// Lanes<Pixel, Acc> provides: V (vector of Acc), N (lanes), load (widen N
+// pixels), loadAcc/store (N accumulators), set1, add, scan (in-register
+// inclusive prefix), last (broadcast lane N-1), first (lane 0), reduce.
+
+#include "integral_loops.inl"
+
+template<class Pixel, class Acc, bool HasPrev>
+static Acc rowPrefixVec(const Pixel* in, const Acc* prev, Acc* out, size_t n, Acc carry) noexcept{
+    using L = Lanes<Pixel, Acc>;
+    constexpr size_t N = L::N;
+    typename L::V c = L::set1(carry);
+    size_t x = 0;
+    for(;x+2*N<=n;x+=2*N){
+        typename L::V a = L::add(L::scan(L::load(in + x)), c);
+        typename L::V b = L::add(L::scan(L::load(in + x + N)), L::last(a));
+        c = L::last(b);
+        if(HasPrev){
+            a = L::add(a, L::loadAcc(prev + x));
+            b = L::add(b, L::loadAcc(prev + x + N));
+        }
+        L::store(out + x, a);
+        L::store(out + x + N, b);
+    }
+    return rowPrefixScalar<Pixel, Acc, HasPrev>(in + x, HasPrev ? prev + x : nullptr, out + x, n - x, L::first(c));
+}
+
+template<class Pixel, class Acc>
+static Acc rowPrefix(const Pixel* in, const Acc* prev, Acc* out, size_t n, Acc carry) noexcept{
+    return prev ? rowPrefixVec<Pixel, Acc, true>(in, prev, out, n, carry) : rowPrefixVec<Pixel, Acc, false>(in, prev, out, n, carry);
+}
+
+// Column accumulation: N accumulators per step, contiguous along the row.
+template<class Pixel, class Acc>
+static void columnSum(const Pixel* in, Acc* acc, size_t n) noexcept{
+    using L = Lanes<Pixel, Acc>;
+    size_t x = 0;
+    for(;x+L::N<=n;x+=L::N) L::store(acc + x, L::add(L::loadAcc(acc + x), L::load(in + x)));
+    columnSumScalar<Pixel, Acc>(in + x, acc + x, n - x);
+}
+
+template<class Pixel, class Acc>
+static Acc rowSum(const Pixel* in, size_t n) noexcept{
+    using L = Lanes<Pixel, Acc>;
+    typename L::V s = L::set1(Acc(0));
+    size_t x = 0;
+    for(;x+L::N<=n;x+=L::N) s = L::add(s, L::load(in + x));
+    return L::reduce(s) + rowSumScalar<Pixel, Acc>(in + x, n - x);
+}
+
+template<class Pixel, class Acc>
+static void tiltedRow(const Pixel* in, Acc* prefix, Acc* right, Acc* left, Acc* out, size_t n) noexcept{
+    rowPrefixVec<Pixel, Acc, false>(in, nullptr, prefix, n, 0);
+    tiltedStep(prefix, right, left, out, n);
+}
+
+template<class Pixel, class Acc>
+static const IntegralKernels<Pixel, Acc>* table() noexcept{
+    static const IntegralKernels<Pixel, Acc> kernels = {rowPrefix<Pixel, Acc>, columnSum<Pixel, Acc>, rowSum<Pixel, Acc>, tiltedRow<Pixel, Acc>, boxRow<Pixel, Acc>, thresholdRow<Pixel, Acc>, deltaColumns<Pixel, Acc>};
+    return &kernels;
+}
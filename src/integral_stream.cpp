@@ -0,0 +1,67 @@
+// integral_stream.cpp
+// Row-by-row integral builder (StreamingIntegral) for streams of unbounded
+// height. Table rows live in a ring of window+1 rows indexed by the absolute
+// row number modulo the ring size.
+
+#include "integral.hpp"
+#include "integral_kernels.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+using std::size_t;
+
+template<class Pixel, class Acc>
+StreamingIntegral<Pixel, Acc>::StreamingIntegral(std::size_t width, std::size_t window)
+    : width_(width), window_(std::max<size_t>(window, 1)){
+    ring_.reset(new Acc[(window_ + 1)*width_]);
+    prefix_.reset(new Acc[width_]);
+}
+
+template<class Pixel, class Acc>
+void StreamingIntegral<Pixel, Acc>::push(const Pixel* in) noexcept{
+    if(width_ == 0) { ++rows_; return; }
+    const Acc* prev = rows_ ? row(rows_ - 1) : nullptr;
+    integralKernels<Pixel, Acc>().rowPrefix(in, prev, ring_.get() + (rows_ % (window_ + 1))*width_, width_, Acc(0));
+    ++rows_;
+}
+
+template<class Pixel, class Acc>
+Acc StreamingIntegral<Pixel, Acc>::rectSum(std::size_t x0, u64 y0, std::size_t x1, u64 y1) const noexcept{
+    const Acc* bottom = row(y1);
+    Acc a = bottom[x1];
+    Acc c = x0 ? bottom[x0-1] : Acc(0);
+    if(y0 == 0) return a - c;
+    const Acc* top = row(y0 - 1);
+    return a - top[x1] - c + (x0 ? top[x0-1] : Acc(0));
+}
+
+// The difference of the table rows bounding the window is the row prefix of
+// the window's column sums, which is what boxRow takes.
+template<class Pixel, class Acc>
+bool StreamingIntegral<Pixel, Acc>::boxFilterRow(std::size_t radius, Pixel* out) noexcept{
+    if(rows_ <= radius || window_ < 2*radius + 1) return false;
+    if(width_ == 0) return true;
+    const u64 y = rows_ - 1 - radius;
+    const Acc* bottom = row(rows_ - 1);
+    Acc* prefix = prefix_.get();
+    size_t rows;
+    if(y > radius){
+        const Acc* top = row(y - radius - 1);
+        for(size_t x=0;x<width_;++x) prefix[x] = bottom[x] - top[x];
+        rows = 2*radius + 1;
+    }else{
+        std::copy(bottom, bottom + width_, prefix);
+        rows = static_cast<size_t>(y) + radius + 1;
+    }
+    integralKernels<Pixel, Acc>().boxRow(prefix, out, width_, radius, rows);
+    return true;
+}
+
+template class StreamingIntegral<u8, u32>;
+template class StreamingIntegral<u16, u32>;
+template class StreamingIntegral<u32, u32>;
+template class StreamingIntegral<u8, u64>;
+template class StreamingIntegral<u16, u64>;
+template class StreamingIntegral<u32, u64>;
+template class StreamingIntegral<float, double>;
@@ -0,0 +1,118 @@
+// integral_tilted.cpp
+// 45-degree rotated summed-area table (computeTiltedIntegral) for tilted Haar
+// features, single-threaded and on the IntegralEngine band split.
+//
+// With P(x, y) the inclusive prefix sum of row y (P(-1, y) = 0, P clamped to
+// the row total for x >= w), the cone sum with apex (x, y) is T = R - L with
+//   R(x, y) = R(x+1, y-1) + P(x, y),      R(w, y) = R(w-1, y)
+//   L(x, y) = L(x-1, y-1) + P(x-1, y),    L(0, y) = 0
+// so each output row needs only the R and L rows above it.
+
+#include "integral.hpp"
+#include "integral_kernels.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+using std::size_t;
+
+// Rows [y0,y1) of the tilted table starting from the diagonal state of row
+// y0-1 in right/left (zeros for the first row). out == nullptr only advances
+// the state. prefix is w scratch accumulators.
+template<class Pixel, class Acc>
+static void tiltedRows(ImageView<Pixel> img, size_t y0, size_t y1, Acc* prefix, Acc* right, Acc* left, const MutableImageView<Acc>* out) noexcept{
+    const auto tiltedRow = integralKernels<Pixel, Acc>().tiltedRow;
+    for(size_t y=y0;y<y1;++y) tiltedRow(img.row(y), prefix, right, left, out ? out->row(y) : nullptr, img.width);
+}
+
+template<class Pixel, class Acc>
+void IntegralEngine::computeTilted(ImageView<Pixel> img, MutableImageView<Acc> tilted, int num_threads) noexcept{
+    const size_t w = img.width, h = img.height;
+    if(w==0 || h==0) return;
+    if(num_threads < 1 || num_threads > pool_->size()) num_threads = pool_->size();
+    const size_t threads = static_cast<size_t>(num_threads);
+
+    size_t rows_per = (h + threads - 1) / threads;
+    size_t bands = (h + rows_per - 1) / rows_per;
+    // per band: prefix, right, left; then the state entering each band (right, left)
+    BufferPtr<Acc> scratch = makeBuffer<Acc>(5*bands*w, BufferPages::Default);
+    if(!scratch && bands > 1){
+        // one band carries no state between bands: prefix, right and left only
+        bands = 1;
+        scratch = makeBuffer<Acc>(3*w, BufferPages::Default);
+    }
+    if(!scratch) return;
+    Acc* work = scratch.get();
+    Acc* state = work + 3*bands*w;
+    auto prefixOf = [&](size_t b){ return work + 3*b*w; };
+    auto rightOf = [&](size_t b){ return work + (3*b + 1)*w; };
+    auto leftOf = [&](size_t b){ return work + (3*b + 2)*w; };
+
+    if(bands == 1){
+        std::fill(rightOf(0), rightOf(0) + 2*w, Acc(0));
+        tiltedRows(img, 0, h, prefixOf(0), rightOf(0), leftOf(0), &tilted);
+        return;
+    }
+
+    // Phase 1: diagonal sums of every band but the last over its own rows only
+    pool_->run(bands-1, [&](size_t b){
+        std::fill(rightOf(b), rightOf(b) + 2*w, Acc(0));
+        tiltedRows<Pixel, Acc>(img, b*rows_per, (b+1)*rows_per, prefixOf(b), rightOf(b), leftOf(b), nullptr);
+    });
+
+    // Chain the band sums: entering band b, R(x) = R_b-1(x) + R_in(min(x + rows, w-1))
+    // and L(x) = L_b-1(x) + L_in(x - rows), rows being the height of band b-1.
+    std::fill(state, state + 2*w, Acc(0));
+    for(size_t b=1;b<bands;++b){
+        const Acc* inR = state + 2*(b-1)*w;
+        const Acc* inL = inR + w;
+        Acc* R = state + 2*b*w;
+        Acc* L = R + w;
+        for(size_t x=0;x<w;++x){
+            R[x] = rightOf(b-1)[x] + inR[std::min(x + rows_per, w-1)];
+            L[x] = leftOf(b-1)[x] + (x >= rows_per ? inL[x - rows_per] : Acc(0));
+        }
+    }
+
+    // Phase 2: each band writes its rows from the state entering it
+    pool_->run(bands, [&](size_t b){
+        size_t y0 = b*rows_per;
+        size_t y1 = std::min(h, y0 + rows_per);
+        std::copy(state + 2*b*w, state + 2*(b+1)*w, rightOf(b));
+        tiltedRows(img, y0, y1, prefixOf(b), rightOf(b), leftOf(b), &tilted);
+    });
+}
+
+template<class Pixel, class Acc>
+void IntegralEngine::computeTilted(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& tilted, int num_threads) noexcept{
+    if(w==0 || h==0) { tilted.clear(); return; }
+    tilted.resize(w*h);
+    computeTilted(ImageView<Pixel>(img, w, h), MutableImageView<Acc>(tilted, w, h), num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeTiltedIntegral(ImageView<Pixel> img, MutableImageView<Acc> tilted, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeTilted(img, tilted, num_threads);
+}
+
+template<class Pixel, class Acc>
+void computeTiltedIntegral(const std::vector<Pixel>& img, std::size_t w, std::size_t h, std::vector<Acc>& tilted, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->computeTilted(img, w, h, tilted, num_threads);
+}
+
+#define INTEGRAL_INSTANTIATE_TILTED(Pixel, Acc) \
+    template void IntegralEngine::computeTilted<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>, int) noexcept; \
+    template void IntegralEngine::computeTilted<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, int) noexcept; \
+    template void computeTiltedIntegral<Pixel, Acc>(ImageView<Pixel>, MutableImageView<Acc>, int) noexcept; \
+    template void computeTiltedIntegral<Pixel, Acc>(const std::vector<Pixel>&, std::size_t, std::size_t, std::vector<Acc>&, int) noexcept;
+INTEGRAL_INSTANTIATE_TILTED(u8, u32)
+INTEGRAL_INSTANTIATE_TILTED(u16, u32)
+INTEGRAL_INSTANTIATE_TILTED(u32, u32)
+INTEGRAL_INSTANTIATE_TILTED(u8, u64)
+INTEGRAL_INSTANTIATE_TILTED(u16, u64)
+INTEGRAL_INSTANTIATE_TILTED(u32, u64)
+INTEGRAL_INSTANTIATE_TILTED(float, double)
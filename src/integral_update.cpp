@@ -0,0 +1,117 @@
+// integral_update.cpp
+// Incremental update of an integral table for a changed rectangle
+// (updateIntegral), on the IntegralEngine band split.
+//
+// With D the integral of the change img - previous over the dirty rectangle
+// [x0,x1] x [y0,y1], the new table is I + D, and D is zero above y0 and left
+// of x0, constant along each row right of x1 and constant down each column
+// below y1. Each table row from y0 down therefore gains one row D(., y) on
+// [x0, w): the row prefix of the change's column sums, extended by its total.
+
+#include "integral.hpp"
+#include "integral_kernels.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+using std::size_t;
+
+template<class Pixel, class Acc>
+void IntegralEngine::update(ImageView<Pixel> img, ImageView<Pixel> previous, const ImageRect& dirty, MutableImageView<Acc> integral, int num_threads) noexcept{
+    const size_t w = img.width, h = img.height;
+    if(dirty.x0 >= w || dirty.y0 >= h || dirty.x1 < dirty.x0 || dirty.y1 < dirty.y0) return;
+    const size_t x0 = dirty.x0, y0 = dirty.y0, x1 = std::min(dirty.x1, w-1), y1 = std::min(dirty.y1, h-1);
+    if(num_threads < 1 || num_threads > pool_->size()) num_threads = pool_->size();
+
+    // Updating reads and writes the table over the lower-right region; a full
+    // recompute reads the image and writes the table once. Past half the
+    // table the update is no longer the cheaper pass.
+    const size_t span = w - x0, rows = h - y0;
+    if(2*span*rows > w*h){
+        compute(img, integral, num_threads);
+        return;
+    }
+
+    const auto& k = integralKernels<Pixel, Acc>();
+    const auto& acc = integralKernels<Acc, Acc>();
+    const size_t dw = x1 - x0 + 1;
+    const size_t threads = static_cast<size_t>(num_threads);
+    size_t rows_per = (rows + threads - 1) / threads;
+    size_t bands = (rows + rows_per - 1) / rows_per;
+    // per band: column sums of the change entering it (dw), its D row (span);
+    // then one more dw block for the serial prefix
+    BufferPtr<Acc> scratch = makeBuffer<Acc>(bands*(dw + span) + dw, BufferPages::Default);
+    if(!scratch){
+        // the full recompute of the large-rectangle case needs no scratch of its own
+        compute(img, integral, num_threads);
+        return;
+    }
+    auto columnsOf = [&](size_t b){ return scratch.get() + b*(dw + span); };
+    auto rowOf = [&](size_t b){ return columnsOf(b) + dw; };
+    Acc* run = scratch.get() + bands*(dw + span);
+
+    // Phase 1: column sums of the change over each band's dirty rows
+    pool_->run(bands, [&](size_t b){
+        Acc* c = columnsOf(b);
+        std::fill(c, c + dw, Acc(0));
+        size_t end = std::min(y0 + (b+1)*rows_per, y1 + 1);
+        for(size_t y=y0 + b*rows_per;y<end;++y) k.deltaColumns(img.row(y) + x0, previous.row(y) + x0, c, dw);
+    });
+
+    // Exclusive prefix over the bands: the column sums entering each band
+    std::fill(run, run + dw, Acc(0));
+    for(size_t b=0;b<bands;++b){
+        Acc* c = columnsOf(b);
+        for(size_t i=0;i<dw;++i){
+            Acc local = c[i];
+            c[i] = run[i];
+            run[i] += local;
+        }
+    }
+
+    // Phase 2: rebuild D for every dirty row, then reuse the last one below the rectangle
+    pool_->run(bands, [&](size_t b){
+        Acc* c = columnsOf(b);
+        Acc* d = rowOf(b);
+        size_t begin = y0 + b*rows_per;
+        size_t end = std::min(h, begin + rows_per);
+        bool current = false;
+        for(size_t y=begin;y<end;++y){
+            if(y <= y1){
+                k.deltaColumns(img.row(y) + x0, previous.row(y) + x0, c, dw);
+                current = false;
+            }
+            if(!current){
+                Acc total = acc.rowPrefix(c, nullptr, d, dw, Acc(0));
+                std::fill(d + dw, d + span, total);
+                current = y >= y1;
+            }
+            acc.columnSum(d, integral.row(y) + x0, span);
+        }
+    });
+}
+
+template<class Pixel, class Acc>
+void updateIntegral(ImageView<Pixel> img, ImageView<Pixel> previous, const ImageRect& dirty, MutableImageView<Acc> integral, int num_threads) noexcept{
+    if(num_threads < 1) num_threads = 1;
+    defaultIntegralEngine(num_threads)->update(img, previous, dirty, integral, num_threads);
+}
+
+template<class Pixel, class Acc>
+void updateIntegral(const std::vector<Pixel>& img, const std::vector<Pixel>& previous, std::size_t w, std::size_t h, const ImageRect& dirty, std::vector<Acc>& integral, int num_threads) noexcept{
+    updateIntegral(ImageView<Pixel>(img, w, h), ImageView<Pixel>(previous, w, h), dirty, MutableImageView<Acc>(integral, w, h), num_threads);
+}
+
+#define INTEGRAL_INSTANTIATE_UPDATE(Pixel, Acc) \
+    template void IntegralEngine::update<Pixel, Acc>(ImageView<Pixel>, ImageView<Pixel>, const ImageRect&, MutableImageView<Acc>, int) noexcept; \
+    template void updateIntegral<Pixel, Acc>(ImageView<Pixel>, ImageView<Pixel>, const ImageRect&, MutableImageView<Acc>, int) noexcept; \
+    template void updateIntegral<Pixel, Acc>(const std::vector<Pixel>&, const std::vector<Pixel>&, std::size_t, std::size_t, const ImageRect&, std::vector<Acc>&, int) noexcept;
+INTEGRAL_INSTANTIATE_UPDATE(u8, u32)
+INTEGRAL_INSTANTIATE_UPDATE(u16, u32)
+INTEGRAL_INSTANTIATE_UPDATE(u32, u32)
+INTEGRAL_INSTANTIATE_UPDATE(u8, u64)
+INTEGRAL_INSTANTIATE_UPDATE(u16, u64)
+INTEGRAL_INSTANTIATE_UPDATE(u32, u64)
+INTEGRAL_INSTANTIATE_UPDATE(float, double)
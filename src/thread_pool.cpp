@@ -0,0 +1,135 @@
+// thread_pool.cpp
+// Persistent worker pool with spin-then-park barriers and work-stealing task deques.
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using std::size_t;
+
+// Iterations a waiting thread polls before parking on a condition variable.
+static constexpr int kSpinIterations = 4096;
+
+static inline void cpuRelax() noexcept{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Bind a thread to one CPU; false where unsupported or refused.
+static bool pinThread(std::thread& th, int cpu) noexcept{
+#ifdef __linux__
+    if(cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(th.native_handle(), sizeof(set), &set) == 0;
+#else
+    (void)th;
+    (void)cpu;
+    return false;
+#endif
+}
+
+ThreadPool::ThreadPool(int num_threads, std::vector<int> cpus) : cpus_(std::move(cpus)){
+    if(num_threads < 1) num_threads = 1;
+    if(cpus_.size() > static_cast<size_t>(num_threads)) cpus_.resize(static_cast<size_t>(num_threads));
+    deques_.reset(new TaskDeque[static_cast<size_t>(num_threads)]);
+    workers_.reserve(static_cast<size_t>(num_threads - 1));
+    for(int t=1;t<num_threads;++t){
+        workers_.emplace_back(&ThreadPool::workerLoop, this, static_cast<size_t>(t));
+        // bound before the first batch is published, i.e. before the worker
+        // touches any task memory; a CPU that cannot be bound reads as unpinned
+        size_t i = static_cast<size_t>(t);
+        if(i < cpus_.size() && cpus_[i] >= 0 && !pinThread(workers_.back(), cpus_[i])) cpus_[i] = -1;
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        stop_ = true;
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+    wake_.notify_all();
+    for(auto &th: workers_) th.join();
+}
+
+// Run the own deque dry, then steal until a sweep finds every deque empty
+// (a lost race does not count as empty, since the winner may leave more).
+void ThreadPool::drain(size_t self){
+    if(self >= participants_) return;
+    size_t task;
+    while(deques_[self].take(task)) (*fn_)(task);
+    for(;;){
+        bool contended = false, stolen = false;
+        for(size_t k=1;k<participants_ && !stolen;++k){
+            TaskDeque::Steal r = deques_[(self + k) % participants_].steal(task);
+            if(r == TaskDeque::Steal::Success) { (*fn_)(task); stolen = true; }
+            else if(r == TaskDeque::Steal::Abort) contended = true;
+        }
+        if(!stolen && !contended) return;
+    }
+}
+
+void ThreadPool::workerLoop(size_t self){
+    std::uint64_t seen = 0;
+    for(;;){
+        std::uint64_t g = generation_.load(std::memory_order_acquire);
+        for(int i=0;i<kSpinIterations && g==seen;++i){
+            cpuRelax();
+            g = generation_.load(std::memory_order_acquire);
+        }
+        if(g == seen){
+            std::unique_lock<std::mutex> lk(mutex_);
+            wake_.wait(lk, [&]{ return generation_.load(std::memory_order_acquire) != seen; });
+            g = generation_.load(std::memory_order_acquire);
+            if(stop_) return;
+        }
+        seen = g;
+        if(stop_) return;
+
+        drain(self);
+        if(arrived_.fetch_add(1, std::memory_order_acq_rel) + 1 == workers_.size()){
+            std::lock_guard<std::mutex> lk(mutex_);
+            done_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::run(size_t tasks, const std::function<void(size_t)>& fn, int threads){
+    if(tasks == 0) return;
+    if(threads < 1 || threads > size()) threads = size();
+    if(threads == 1 || tasks == 1){
+        for(size_t i=0;i<tasks;++i) fn(i);
+        return;
+    }
+    std::lock_guard<std::mutex> runLock(runMutex_);
+    fn_ = &fn;
+    // contiguous shares, so neighbouring tasks (adjacent bands) run on one thread unless stolen
+    participants_ = std::min(static_cast<size_t>(threads), tasks);
+    for(size_t t=0;t<participants_;++t) deques_[t].reset(t*tasks/participants_, (t+1)*tasks/participants_);
+    arrived_.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+    wake_.notify_all();
+
+    drain(0);
+
+    // end-of-batch barrier: every worker has observed this generation and run out of tasks
+    for(int i=0;i<kSpinIterations && arrived_.load(std::memory_order_acquire) != workers_.size();++i) cpuRelax();
+    if(arrived_.load(std::memory_order_acquire) != workers_.size()){
+        std::unique_lock<std::mutex> lk(mutex_);
+        done_.wait(lk, [&]{ return arrived_.load(std::memory_order_acquire) == workers_.size(); });
+    }
+}
@@ -0,0 +1,130 @@
+// thread_pool.hpp
+// Persistent worker pool with spin-then-park barriers and work-stealing task
+// deques, used by IntegralEngine.
+// See src/thread_pool.cpp for implementations.
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Chase-Lev work-stealing deque over one contiguous range of task indices.
+ *
+ * The range is installed by reset() before the batch is published, so the
+ * deque never grows and needs no buffer: position p holds task last - p.
+ * The owner takes from the bottom (ascending task order, good locality);
+ * thieves steal from the top, i.e. the far end of the owner's range.
+ */
+class TaskDeque {
+public:
+    enum class Steal { Success, Empty, Abort };
+
+    /** Hold tasks [begin, end); not concurrent with take() or steal(). */
+    void reset(std::size_t begin, std::size_t end) noexcept{
+        last_ = end - 1;
+        top_.store(0, std::memory_order_relaxed);
+        bottom_.store(static_cast<std::int64_t>(end - begin), std::memory_order_relaxed);
+    }
+
+    /** Owner only: next task in ascending order; false once the deque is empty. */
+    bool take(std::size_t& task) noexcept{
+        std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top_.load(std::memory_order_relaxed);
+        bool ok = t <= b;
+        // the last task is raced for with the thieves
+        if(ok && t == b) ok = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        if(!ok || t == b) bottom_.store(b + 1, std::memory_order_relaxed);
+        if(ok) task = last_ - static_cast<std::size_t>(b);
+        return ok;
+    }
+
+    /** Any thread: a task from the top; Abort means another thread won the race, so retry. */
+    Steal steal(std::size_t& task) noexcept{
+        std::int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t b = bottom_.load(std::memory_order_acquire);
+        if(t >= b) return Steal::Empty;
+        if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return Steal::Abort;
+        task = last_ - static_cast<std::size_t>(t);
+        return Steal::Success;
+    }
+
+private:
+    alignas(64) std::atomic<std::int64_t> top_{0};
+    alignas(64) std::atomic<std::int64_t> bottom_{0};
+    std::size_t last_ = 0;
+};
+
+/**
+ * Fixed-size pool of worker threads that stay alive between calls.
+ *
+ * run() publishes a batch of tasks, executes tasks on the calling thread as
+ * well, and returns once every worker has passed the end-of-batch barrier.
+ * Each participating thread starts on its own contiguous share of the tasks
+ * in a TaskDeque and, once that is empty, steals from the others, so a
+ * thread that is descheduled or slow has its remaining tasks taken over.
+ * Idle workers spin briefly on the batch generation before parking on a
+ * condition variable, so back-to-back phases are picked up without a syscall
+ * while an idle pool costs no CPU.
+ */
+class ThreadPool {
+public:
+    /**
+     * @param num_threads Total threads including the caller (>=1); num_threads-1 workers are spawned.
+     * @param cpus Optional pinning: worker t (1 <= t < num_threads) is bound to CPU cpus[t]
+     *        before it runs any task, so memory it first touches is placed on that CPU's node.
+     *        Entries that are missing or negative leave the thread unpinned; cpus[0] stands for
+     *        the calling thread, whose affinity is never changed.
+     */
+    explicit ThreadPool(int num_threads, std::vector<int> cpus = {});
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** Total number of threads taking part in run(), including the caller. */
+    int size() const noexcept { return static_cast<int>(workers_.size()) + 1; }
+
+    /** CPU thread t is pinned to, or -1 if it is not pinned (always -1 for the caller, t = 0). */
+    int cpu(std::size_t t) const noexcept { return t > 0 && t < cpus_.size() ? cpus_[t] : -1; }
+
+    /**
+     * Execute fn(i) for every i in [0, tasks) and wait for completion.
+     * Tasks are balanced by work stealing; fn must not call run() on the same pool.
+     * Concurrent callers are serialised.
+     *
+     * @param threads Threads that take part (the caller and the first threads-1
+     *        workers); <1 or more than size() means all.
+     */
+    void run(std::size_t tasks, const std::function<void(std::size_t)>& fn, int threads = 0);
+
+private:
+    void workerLoop(std::size_t self);
+    void drain(std::size_t self);
+
+    std::vector<std::thread> workers_;
+    std::vector<int> cpus_;
+    std::mutex runMutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::atomic<std::uint64_t> generation_{0};
+    std::unique_ptr<TaskDeque[]> deques_;
+    std::atomic<std::size_t> arrived_{0};
+    std::size_t participants_ = 0;
+    const std::function<void(std::size_t)>* fn_ = nullptr;
+    bool stop_ = false;
+};
+
+#endif // THREAD_POOL_HPP
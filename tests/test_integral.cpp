@@ -1,8 +1,23 @@
 #include "../src/integral.hpp"
+#include "../src/integral_kernels.hpp"
+#include "../src/thread_pool.hpp"
 #include <iostream>
 #include <vector>
 #include <random>
 #include <cassert>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 
 using std::cout; using std::endl;
 
@@ -28,6 +43,809 @@ static void test_random_compare(unsigned w, unsigned h, unsigned seed){
     assert(A==B);
 }
 
+static void test_tiled_bands(){
+    // widths spanning several tiles, more threads than rows
+    const unsigned sizes[][2] = {{2500,7},{1025,33},{3,40},{1,1}};
+    for(auto &sz: sizes){
+        unsigned w=sz[0], h=sz[1];
+        std::mt19937 rng(w*h);
+        std::vector<u32> img(w*h);
+        for(auto &v: img) v = rng();
+        std::vector<u64> A,B;
+        computeIntegralSingle(img,w,h,A);
+        for(int t: {1,2,3,8,64}){
+            computeIntegralMulti(img,w,h,B,t);
+            assert(A==B);
+            computeIntegralStrips(img,w,h,B,t);
+            assert(A==B);
+        }
+    }
+}
+
+// Pixel values kept small and integral so float -> double sums are exact
+template<class Pixel, class Acc>
+static void test_simd_row_kernels(){
+    std::mt19937 rng(77);
+    const IntegralKernels<Pixel, Acc>* ref = integralKernels<Pixel, Acc>(SimdLevel::Scalar);
+    for(SimdLevel l: {SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512}){
+        const IntegralKernels<Pixel, Acc>* k = integralKernels<Pixel, Acc>(l);
+        if(!k) continue; // not supported on this CPU
+        for(size_t n: {0,1,3,4,7,8,15,16,17,31,32,33,100}){
+            std::vector<Pixel> in(n);
+            std::vector<Acc> prev(n), A(n), B(n);
+            for(auto &v: in) v = static_cast<Pixel>(rng()%256);
+            for(auto &v: prev) v = static_cast<Acc>(rng()%100000);
+            Acc carry = static_cast<Acc>(rng()%100000);
+            assert(ref->rowPrefix(in.data(), nullptr, A.data(), n, carry) == k->rowPrefix(in.data(), nullptr, B.data(), n, carry));
+            assert(A==B);
+            assert(ref->rowPrefix(in.data(), prev.data(), A.data(), n, carry) == k->rowPrefix(in.data(), prev.data(), B.data(), n, carry));
+            assert(A==B);
+            assert(ref->rowSum(in.data(), n) == k->rowSum(in.data(), n));
+            ref->columnSum(in.data(), A.data(), n);
+            k->columnSum(in.data(), B.data(), n);
+            assert(A==B);
+            if(n){
+                std::vector<Acc> P(n), RA(prev), LA(prev), RB(prev), LB(prev);
+                ref->tiltedRow(in.data(), P.data(), RA.data(), LA.data(), A.data(), n);
+                k->tiltedRow(in.data(), P.data(), RB.data(), LB.data(), B.data(), n);
+                assert(A==B && RA==RB && LA==LB);
+            }
+        }
+    }
+}
+
+template<class Pixel, class Acc>
+static void test_pixel_types(){
+    std::mt19937 rng(99);
+    for(unsigned w: {1u,13u,40u}) for(unsigned h: {1u,9u,30u}){
+        std::vector<Pixel> img(w*h);
+        for(auto &v: img) v = static_cast<Pixel>(rng()%256);
+        std::vector<Acc> R,A,B,C,D;
+        computeIntegralNaive(img,w,h,R);
+        computeIntegralSingle(img,w,h,A);
+        computeIntegralMulti(img,w,h,B,3);
+        computeIntegralStrips(img,w,h,C,3);
+        computeIntegralAuto(img,w,h,D);
+        assert(R==A && R==B && R==C && R==D);
+    }
+}
+
+// Fused tables against the integral of the image and a scalar integral of a squared copy
+template<class Pixel, class Acc, class Sq>
+static void test_squared_integral(unsigned max_value){
+    std::mt19937 rng(31);
+    for(unsigned w: {1u,17u,1100u}) for(unsigned h: {1u,10u,37u}){
+        std::vector<Pixel> img(w*h);
+        std::vector<Sq> sq(w*h);
+        for(size_t i=0;i<img.size();++i){
+            img[i] = static_cast<Pixel>(rng()%(max_value+1));
+            sq[i] = static_cast<Sq>(img[i]) * static_cast<Sq>(img[i]);
+        }
+        std::vector<Acc> R;
+        std::vector<Sq> RQ(w*h);
+        computeIntegralSingle(img,w,h,R);
+        for(size_t y=0;y<h;++y){
+            Sq s = 0;
+            for(size_t x=0;x<w;++x){
+                s += sq[y*w + x];
+                RQ[y*w + x] = s + (y ? RQ[(y-1)*w + x] : 0);
+            }
+        }
+        for(int t: {1,2,3,5}){
+            std::vector<Acc> S;
+            std::vector<Sq> Q;
+            computeIntegralSquared(img,w,h,S,Q,t);
+            assert(S==R && Q==RQ);
+        }
+    }
+}
+
+// Tilted table against the cone definition, and rotated rectangles against
+// a direct sum over their pixels
+template<class Pixel, class Acc>
+static void test_tilted_integral(){
+    std::mt19937 rng(45);
+    for(unsigned w: {1u,2u,7u,23u}) for(unsigned h: {1u,3u,16u,29u}){
+        std::vector<Pixel> img(w*h);
+        for(auto &v: img) v = static_cast<Pixel>(rng()%256);
+        auto px = [&](long x, long y){ return static_cast<Acc>(img[y*w + x]); };
+        std::vector<Acc> R(w*h, 0);
+        for(long y=0;y<(long)h;++y) for(long x=0;x<(long)w;++x){
+            Acc s = 0;
+            for(long yy=0;yy<=y;++yy) for(long xx=0;xx<(long)w;++xx) if(std::labs(xx-x) <= y-yy) s += px(xx,yy);
+            R[y*w + x] = s;
+        }
+        for(int t: {1,2,3,4,7}){
+            std::vector<Acc> T;
+            computeTiltedIntegral(img,w,h,T,t);
+            assert(T==R);
+        }
+        for(long x=0;x<(long)w;++x) for(long y=0;y<(long)h;++y)
+        for(long rw=1;rw<=5 && x+rw<=(long)w && y+rw<(long)h;++rw) for(long rh=1;rh<=5 && rh<=x && y+rw+rh<=(long)h;++rh){
+            Acc s = 0;
+            for(long yy=0;yy<(long)h;++yy) for(long xx=0;xx<(long)w;++xx){
+                long u = xx+yy - (x+y), v = (yy-xx) - (y-x);
+                if(u>=0 && u<2*rw && v>=0 && v<2*rh) s += px(xx,yy);
+            }
+            assert(tiltedRectSum(R, w, x, y, rw, rh) == s);
+        }
+    }
+}
+
+// Box filter against direct window means; integer outputs within rounding
+template<class Pixel>
+static void test_box_filter(){
+    std::mt19937 rng(14);
+    FilterWorkspace<Pixel> ws;
+    for(size_t w: {1u,9u,40u}) for(size_t h: {1u,7u,33u}) for(size_t r: {0u,1u,3u,50u}){
+        std::vector<Pixel> img(w*h);
+        for(auto &v: img) v = static_cast<Pixel>(rng()%256);
+        for(int t: {1,3}){
+            std::vector<Pixel> out;
+            boxFilter(img,w,h,r,out,t);
+            // a workspace reused across sizes gives the same output
+            std::vector<Pixel> out_ws(w*h);
+            assert(boxFilter(ImageView<Pixel>(img,w,h), r, MutableImageView<Pixel>(out_ws,w,h), ws, t));
+            assert(out_ws == out);
+            for(size_t y=0;y<h;++y) for(size_t x=0;x<w;++x){
+                double s = 0, n = 0;
+                for(size_t yy=(y>r?y-r:0);yy<=std::min(h-1,y+r);++yy) for(size_t xx=(x>r?x-r:0);xx<=std::min(w-1,x+r);++xx){ s += img[yy*w + xx]; n += 1; }
+                double d = static_cast<double>(out[y*w + x]) - s/n;
+                assert(d <= 0.5 + 1e-9 && d >= -0.5 - 1e-9);
+                if(std::is_floating_point<Pixel>::value) assert(d < 1e-4 && d > -1e-4);
+            }
+        }
+    }
+}
+
+// Both threshold rules against window statistics computed directly
+template<class Pixel>
+static void test_adaptive_threshold(){
+    std::mt19937 rng(15);
+    FilterWorkspace<Pixel> ws;
+    assert(!ws.reserve(~size_t(0), 2, true));
+    for(size_t w: {1u,12u,45u}) for(size_t h: {1u,8u,31u}) for(size_t r: {0u,2u,9u}){
+        std::vector<Pixel> img(w*h);
+        for(auto &v: img) v = static_cast<Pixel>(rng()%256);
+        for(ThresholdMethod m: {ThresholdMethod::Bradley, ThresholdMethod::Sauvola}){
+            ThresholdParams p;
+            p.method = m;
+            p.radius = r;
+            p.k = (m == ThresholdMethod::Bradley) ? 0.15 : 0.3;
+            for(int t: {1,3}){
+                std::vector<u8> mask;
+                adaptiveThreshold(img,w,h,mask,p,t);
+                std::vector<u8> mask_ws(w*h);
+                assert(adaptiveThreshold(ImageView<Pixel>(img,w,h), MutableImageView<u8>(mask_ws,w,h), p, ws, t));
+                assert(mask_ws == mask);
+                for(size_t y=0;y<h;++y) for(size_t x=0;x<w;++x){
+                    double s = 0, q = 0, n = 0;
+                    for(size_t yy=(y>r?y-r:0);yy<=std::min(h-1,y+r);++yy) for(size_t xx=(x>r?x-r:0);xx<=std::min(w-1,x+r);++xx){
+                        double v = img[yy*w + xx];
+                        s += v; q += v*v; n += 1;
+                    }
+                    double mean = s/n, T;
+                    if(m == ThresholdMethod::Bradley) T = mean*(1.0 - p.k);
+                    else T = mean*(1.0 + p.k*(std::sqrt(std::max(q/n - mean*mean, 0.0))/p.R - 1.0));
+                    assert(mask[y*w + x] == (img[y*w + x] > T ? 255 : 0));
+                }
+            }
+        }
+    }
+}
+
+// Region histograms against direct counts, for u16, u32 and wrapping u16 counters
+static void test_integral_histogram(){
+    std::mt19937 rng(16);
+    struct Case { size_t w, h; unsigned bins; bool wrap; };
+    for(Case c: {Case{1,1,1,false}, Case{37,23,16,false}, Case{300,250,32,false}, Case{300,250,7,true}}){
+        std::vector<u8> img(c.w*c.h);
+        for(auto &v: img) v = static_cast<u8>(rng());
+        for(int t: {1,3}){
+            IntegralHistogram H;
+            H.compute(img,c.w,c.h,c.bins,t,c.wrap);
+            assert(H.bins()==c.bins && H.width()==c.w && H.height()==c.h);
+            assert(H.wideCounters() == (c.w*c.h >= 65536 && !c.wrap));
+            assert(H.wrapping() == (c.w*c.h >= 65536 && c.wrap));
+            std::vector<u32> hist(c.bins), ref(c.bins);
+            for(int i=0;i<40;++i){
+                size_t x0 = rng()%c.w, x1 = rng()%c.w, y0 = rng()%c.h, y1 = rng()%c.h;
+                if(x0>x1) std::swap(x0,x1);
+                if(y0>y1) std::swap(y0,y1);
+                if(i==0){ x0 = 0; y0 = 0; }
+                if(c.wrap && (x1-x0+1)*(y1-y0+1) >= 65536) y1 = y0 + 65535/(x1-x0+1) - 1;
+                std::fill(ref.begin(), ref.end(), 0u);
+                for(size_t y=y0;y<=y1;++y) for(size_t x=x0;x<=x1;++x) ++ref[img[y*c.w + x]*c.bins/256];
+                H.query(x0,y0,x1,y1,hist.data());
+                assert(hist==ref);
+            }
+        }
+    }
+    // a table whose size overflows leaves the histogram empty
+    IntegralHistogram H;
+    std::vector<u8> px(1);
+    H.compute(ImageView<u8>(px.data(), size_t(1) << 40, size_t(1) << 30, 1), 16);
+    assert(H.bins()==0 && H.width()==0 && H.height()==0);
+}
+
+// Dirty-rectangle updates against a full recompute, including the fallback and clipping
+template<class Pixel, class Acc>
+static void test_update_integral(){
+    std::mt19937 rng(17);
+    for(size_t w: {1u,9u,64u}) for(size_t h: {1u,7u,50u}) for(int t: {1,3}){
+        std::vector<Pixel> prev(w*h), img;
+        for(auto &v: prev) v = static_cast<Pixel>(rng()%256);
+        std::vector<Acc> I, ref;
+        computeIntegralSingle(prev,w,h,I);
+        for(int i=0;i<20;++i){
+            ImageRect d{rng()%w, rng()%h, 0, 0};
+            d.x1 = d.x0 + rng()%(i<10 ? 4 : w + 2);
+            d.y1 = d.y0 + rng()%(i<10 ? 4 : h + 2);
+            img = prev;
+            for(size_t y=d.y0;y<=std::min(d.y1,h-1);++y) for(size_t x=d.x0;x<=std::min(d.x1,w-1);++x) img[y*w + x] = static_cast<Pixel>(rng()%256);
+            updateIntegral(img,prev,w,h,d,I,t);
+            computeIntegralSingle(img,w,h,ref);
+            assert(I==ref);
+            prev = img;
+        }
+    }
+}
+
+// Streamed table rows, window queries and box rows against the whole-image functions
+template<class Pixel, class Acc>
+static void test_streaming_integral(){
+    std::mt19937 rng(18);
+    for(size_t w: {1u,13u,70u}) for(size_t r: {0u,1u,4u}){
+        const size_t h = 40, window = 2*r + 1 + rng()%3;
+        std::vector<Pixel> img(w*h), box;
+        for(auto &v: img) v = static_cast<Pixel>(rng()%256);
+        std::vector<Acc> ref;
+        computeIntegralSingle(img,w,h,ref);
+        boxFilter(img,w,h,r,box);
+        StreamingIntegral<Pixel, Acc> s(w, window);
+        std::vector<Pixel> out(w);
+        size_t emitted = 0;
+        for(size_t y=0;y<h;++y){
+            s.push(img.data() + y*w);
+            assert(s.rows()==y+1);
+            for(size_t x=0;x<w;++x) assert(s.row(y)[x]==ref[y*w + x]);
+            for(int i=0;i<5;++i){
+                size_t x0 = rng()%w, x1 = rng()%w;
+                u64 y0 = y + 1 - std::min<size_t>(y + 1, window) + rng()%std::min<size_t>(y + 1, window), y1 = y;
+                if(x0>x1) std::swap(x0,x1);
+                assert(s.rectSum(x0,y0,x1,y1)==integralRectSum(ref,w,x0,y0,x1,y1));
+            }
+            bool ready = s.boxFilterRow(r, out.data());
+            assert(ready == (y >= r));
+            if(ready){
+                size_t yo = y - r;
+                assert(yo == emitted);
+                if(yo + r < h) for(size_t x=0;x<w;++x){
+                    if(std::is_floating_point<Pixel>::value){
+                        double d = static_cast<double>(out[x]) - static_cast<double>(box[yo*w + x]);
+                        assert(d < 1e-4 && d > -1e-4);
+                    }else{
+                        assert(out[x]==box[yo*w + x]);
+                    }
+                }
+                ++emitted;
+            }
+        }
+        if(r > 0){
+            // a window too short for the box never yields rows
+            StreamingIntegral<Pixel, Acc> small(w, 2*r);
+            for(size_t y=0;y<h;++y) small.push(img.data() + y*w);
+            assert(!small.boxFilterRow(r, out.data()));
+        }
+    }
+}
+
+// Out-of-core strips against the in-memory table, with headers and several strip heights
+static void test_integral_file(){
+    const char* in = "/tmp/integral_file_test.raw";
+    const char* out = "/tmp/integral_file_test.sat";
+    std::mt19937 rng(19);
+    const size_t w = 37, h = 29;
+    std::vector<u16> img(w*h);
+    for(auto &v: img) v = static_cast<u16>(rng());
+    std::vector<u64> ref;
+    computeIntegralSingle(img,w,h,ref);
+    const char header[5] = {'H','E','A','D','\n'};
+    FILE* f = std::fopen(in, "wb");
+    std::fwrite(header, 1, sizeof(header), f);
+    std::fwrite(img.data(), sizeof(u16), img.size(), f);
+    std::fclose(f);
+    for(size_t rows: {0u,1u,4u,29u,100u}){
+        std::remove(out);
+        OutOfCoreOptions o;
+        o.stripRows = rows;
+        o.inputOffset = sizeof(header);
+        o.outputOffset = 3;
+        assert((computeIntegralFile<u16,u64>(in, out, w, h, o)));
+        std::vector<u64> table(w*h);
+        f = std::fopen(out, "rb");
+        std::fseek(f, 3, SEEK_SET);
+        assert(std::fread(table.data(), sizeof(u64), table.size(), f) == table.size());
+        assert(std::fgetc(f) == EOF);
+        std::fclose(f);
+        assert(table==ref);
+    }
+    // a short input file fails
+    assert(!(computeIntegralFile<u16,u64>(in, out, w, h + 1)));
+    assert(!(computeIntegralFile<u16,u64>("/nonexistent/integral.raw", out, w, h)));
+    std::remove(in);
+    std::remove(out);
+}
+
+// Interleaved and planar multi-channel tables against per-channel computeIntegralSingle
+template<class Acc>
+static void test_multichannel_integral(){
+    std::mt19937 rng(20);
+    for(unsigned c=1;c<=4;++c) for(size_t w: {1u,17u}) for(size_t h: {1u,9u}){
+        std::vector<u8> img(w*h*c);
+        for(auto &v: img) v = static_cast<u8>(rng());
+        std::vector<Acc> inter(w*h*c), planes(c*w*h);
+        computeIntegralInterleaved(ImageView<u8>(img, w*c, h), c, MutableImageView<Acc>(inter, w*c, h));
+        std::vector<MutableImageView<Acc>> views;
+        for(unsigned k=0;k<c;++k) views.emplace_back(planes.data() + k*w*h, w, h);
+        computeIntegralPlanar(ImageView<u8>(img, w*c, h), c, views.data());
+        for(unsigned k=0;k<c;++k){
+            std::vector<u8> plane(w*h);
+            for(size_t i=0;i<w*h;++i) plane[i] = img[i*c + k];
+            std::vector<u32> ref;
+            computeIntegralSingle(plane,w,h,ref);
+            for(size_t i=0;i<w*h;++i){
+                assert(inter[i*c + k]==ref[i]);
+                assert(planes[k*w*h + i]==ref[i]);
+            }
+        }
+    }
+}
+
+// PGM / PPM / raw mapping and a mapped integral file read back through a second mapping
+static void test_mapped_files(){
+    const char* pgm = "/tmp/integral_map_test.pgm";
+    const char* ppm = "/tmp/integral_map_test.ppm";
+    const char* sat = "/tmp/integral_map_test.sat";
+    std::mt19937 rng(20);
+    const size_t w = 23, h = 11;
+    std::vector<u16> gray(w*h);
+    for(auto &v: gray) v = static_cast<u16>(rng()%1024);
+    FILE* f = std::fopen(pgm, "wb");
+    std::fprintf(f, "P5\n# comment\n%zu %zu\n1023\n", w, h);
+    for(u16 v: gray){ std::fputc(v >> 8, f); std::fputc(v & 0xff, f); }
+    std::fclose(f);
+    MappedImage m;
+    assert(m.openPnm(pgm));
+    assert(m.width()==w && m.height()==h && m.channels()==1 && m.bytesPerSample()==2 && m.bigEndian());
+    std::vector<u16> back;
+    assert(m.copyTo(back) && back==gray);
+    std::vector<u8> narrow;
+    assert(!m.copyTo(narrow));
+    assert(m.samples<u8>().data==nullptr);
+
+    std::vector<u8> rgb(w*h*3);
+    for(auto &v: rgb) v = static_cast<u8>(rng());
+    f = std::fopen(ppm, "wb");
+    std::fprintf(f, "P6 %zu %zu 255\n", w, h);
+    std::fwrite(rgb.data(), 1, rgb.size(), f);
+    std::fclose(f);
+    assert(m.openPnm(ppm));
+    assert(m.channels()==3 && m.bytesPerSample()==1);
+    ImageView<u8> samples = m.samples<u8>();
+    assert(samples.width==3*w && samples.height==h && std::equal(rgb.begin(), rgb.end(), samples.data));
+    MappedImage raw;
+    assert(raw.openRaw(ppm, w, h, 3, 1, std::strlen("P6 23 11 255\n")));
+    assert(std::equal(rgb.begin(), rgb.end(), raw.samples<u8>().data));
+    assert(!raw.openRaw(ppm, w, h + 1, 3, 1));
+    assert(!raw.openPnm(sat + std::string(".missing")));
+
+    {
+        MappedIntegral out;
+        assert(out.create<u32>(sat, w, h, 3));
+        assert(out.table<u64>().data==nullptr);
+        computeIntegralInterleaved(samples, 3, out.table<u32>());
+        assert(out.sync());
+    }
+    MappedIntegral in;
+    assert(in.open(sat));
+    assert(in.header().width==w && in.header().height==h && in.header().channels==3 && in.header().accBytes==4);
+    assert(in.table<u32>().data==nullptr);
+    std::vector<u32> ref(w*h*3);
+    computeIntegralInterleaved(ImageView<u8>(rgb, 3*w, h), 3, MutableImageView<u32>(ref, 3*w, h));
+    ImageView<u32> table = in.view<u32>();
+    assert(table.width==3*w && table.height==h && std::equal(ref.begin(), ref.end(), table.data));
+
+    // zero-padded single-channel layout
+    {
+        MappedIntegral out;
+        assert(out.create<u64>(sat, w, h, 1, IntegralLayout::ZeroPadded));
+        MutableImageView<u64> t = out.table<u64>();
+        assert(t.width==w+1 && t.height==h+1);
+        computeIntegralPadded(ImageView<u16>(gray, w, h), t);
+        assert(paddedRectSum(ImageView<u64>(t), 0, 0, w-1, h-1) == std::accumulate(gray.begin(), gray.end(), u64(0)));
+    }
+
+    // headers whose w*h*channels*bytes wraps 64 bits must not map
+    f = std::fopen(pgm, "wb");
+    std::fprintf(f, "P5 4294967296 4294967296 255\n");
+    for(int i=0;i<16;++i) std::fputc(i, f);
+    std::fclose(f);
+    assert(!m.openPnm(pgm) && m.samples<u8>().data==nullptr);
+    assert(!raw.openRaw(pgm, size_t(1) << 32, size_t(1) << 32, 1, 1));
+    assert(!raw.openRaw(pgm, size_t(1) << 62, 4, 2, 2));
+
+    // tables whose size wraps are not created
+    {
+        MappedIntegral big;
+        assert(!big.create<u64>(sat, size_t(1) << 32, size_t(1) << 32, 3) && big.view<u64>().data==nullptr);
+        assert(!big.create<u32>(sat, size_t(1) << 62, 2, 4));
+        assert(!big.create<u32>(sat, 2, ~size_t(0), 1, IntegralLayout::ZeroPadded));
+    }
+
+    // corrupt integral headers: rows narrower than the image, misaligned data, wrapping sizes
+    auto patched = [&](auto edit){
+        MappedIntegral out;
+        assert(out.create<u64>(sat, w, h, 1));
+        IntegralFileHeader hd = out.header();
+        out.close();
+        edit(hd);
+        FILE* g = std::fopen(sat, "r+b");
+        std::fwrite(&hd, sizeof(hd), 1, g);
+        std::fclose(g);
+        MappedIntegral check;
+        return check.open(sat);
+    };
+    assert(patched([](IntegralFileHeader&){}));
+    assert(!patched([](IntegralFileHeader& hd){ hd.stride = hd.width - 1; }));
+    assert(!patched([](IntegralFileHeader& hd){ hd.dataOffset += 4; }));
+    assert(!patched([](IntegralFileHeader& hd){ hd.height = u64(1) << 62; hd.stride = hd.width = u64(1) << 3; }));
+    assert(!patched([](IntegralFileHeader& hd){ hd.width = hd.stride = ~u64(0); }));
+    std::remove(pgm);
+    std::remove(ppm);
+    std::remove(sat);
+}
+
+// Batches of mixed sizes (including empty and strided views) against computeIntegralSingle
+static void test_integral_batch(){
+    std::mt19937 rng(21);
+    const size_t W = 300, H = 200;
+    std::vector<u16> frame(W*H);
+    for(auto &v: frame) v = static_cast<u16>(rng());
+    for(int t: {1,2,4}){
+        std::vector<ImageView<u16>> images;
+        std::vector<MutableImageView<u64>> outs;
+        std::vector<std::vector<u64>> tables(60);
+        for(size_t i=0;i<tables.size();++i){
+            size_t w = i==0 ? 0 : 1 + rng()%120, h = 1 + rng()%90;
+            images.push_back(ImageView<u16>(frame, W, H).roi(rng()%(W - w + 1), rng()%(H - h + 1), w, h));
+            tables[i].assign(w*h, 0);
+            outs.emplace_back(tables[i], w, h);
+        }
+        computeIntegralBatch(images, outs, t);
+        for(size_t i=0;i<tables.size();++i){
+            std::vector<u64> ref(tables[i].size());
+            computeIntegralSingle(images[i], MutableImageView<u64>(ref, images[i].width, images[i].height));
+            assert(tables[i]==ref);
+        }
+    }
+}
+
+// Look-back engine against computeIntegralSingle, from one block up to many
+// more blocks than threads (wide rows make the L2-sized blocks short, down to one row)
+template<class Pixel, class Acc>
+static void test_lookback_integral(){
+    std::mt19937 rng(23);
+    const size_t sizes[][2] = {{0,5},{5,0},{1,1},{3,7},{257,3},{31,997},{20000,300},{4096,513},{600000,9}};
+    IntegralWorkspace<Acc> ws;
+    for(auto &sz: sizes){
+        size_t w = sz[0], h = sz[1];
+        std::vector<Pixel> img(w*h);
+        for(auto &v: img) v = static_cast<Pixel>(rng()%256);
+        std::vector<Acc> ref, out;
+        computeIntegralSingle(img,w,h,ref);
+        for(int t: {1,2,3,8}){
+            out.assign(w*h, Acc(1));
+            computeIntegralLookBack(img,w,h,out,t);
+            assert(out==ref);
+            // one workspace across all sizes and thread counts
+            ImageView<Acc> r = computeIntegralLookBack(ImageView<Pixel>(img, w, h), ws, t);
+            assert(r.width==w && r.height==h && std::equal(ref.begin(), ref.end(), r.data));
+        }
+    }
+}
+
+// NUMA placement: topology parsing, pinned workers and first touch leave results unchanged
+static void test_numa_engine(){
+    std::vector<std::vector<int>> nodes = numaNodeCpus();
+    assert(!nodes.empty());
+    for(auto &n: nodes) assert(!n.empty() && std::is_sorted(n.begin(), n.end()));
+
+    IntegralEngine engine(4, ThreadPlacement::Numa);
+    assert(engine.threadCpu(0) == -1);
+    for(int t=1;t<4;++t){
+        int c = engine.threadCpu(t);
+        bool known = c == -1;
+        for(auto &n: nodes) known = known || std::binary_search(n.begin(), n.end(), c);
+        assert(known);
+    }
+    assert(IntegralEngine(3).threadCpu(1) == -1);
+
+    std::mt19937 rng(24);
+    const size_t w = 301, h = 257;
+    std::vector<u16> img(w*h);
+    for(auto &v: img) v = static_cast<u16>(rng());
+    std::vector<u64> ref, out(w*h, 1);
+    computeIntegralSingle(img,w,h,ref);
+    MutableImageView<u64> table(out, w, h);
+    engine.firstTouch(table);
+    assert(std::all_of(out.begin(), out.end(), [](u64 v){ return v==0; }));
+    engine.compute(ImageView<u16>(img, w, h), table);
+    assert(out==ref);
+    IntegralWorkspace<u64> ws;
+    ImageView<u64> r = engine.compute(ImageView<u16>(img, w, h), ws, 2);
+    assert(std::equal(ref.begin(), ref.end(), r.data));
+}
+
+// Aligned and huge-page buffers: alignment, usable storage, allocator and workspace
+static void test_buffers(){
+    for(BufferPages pages: {BufferPages::Default, BufferPages::Huge}){
+        for(size_t bytes: {size_t(0), size_t(1), size_t(100), size_t(4096), size_t(2) << 20, (size_t(5) << 20) + 3}){
+            BufferPtr<u8> p = makeBuffer<u8>(bytes, pages);
+            assert(p);
+            std::uintptr_t a = reinterpret_cast<std::uintptr_t>(p.get());
+            assert(a % 64 == 0);
+            if(pages == BufferPages::Huge && bytes >= (size_t(2) << 20)) assert(a % (size_t(2) << 20) == 0);
+            std::memset(p.get(), 0xab, bytes);
+            if(bytes) assert(p[bytes-1] == 0xab);
+        }
+    }
+
+    std::mt19937 rng(25);
+    const size_t w = 1024, h = 300; // table of 2.3 MiB
+    std::vector<u16> img(w*h);
+    for(auto &v: img) v = static_cast<u16>(rng());
+    std::vector<u64> ref;
+    computeIntegralSingle(img,w,h,ref);
+
+    std::vector<u64, IntegralAllocator<u64>> table(w*h, 0, IntegralAllocator<u64>(BufferPages::Huge));
+    computeIntegralMulti(ImageView<u16>(img, w, h), MutableImageView<u64>(table.data(), w, h), 3);
+    assert(std::equal(ref.begin(), ref.end(), table.begin()));
+
+    // sizes that wrap size_t fail cleanly instead of allocating a short buffer
+    assert(!makeBuffer<u64>(size_t(1) << 62, BufferPages::Default));
+    IntegralWorkspace<u64> ws(BufferPages::Huge);
+    assert(!ws.reserve(size_t(1) << 62, 16, 1) && ws.result().data==nullptr && ws.width()==0);
+    assert(ws.pages() == BufferPages::Huge);
+    for(int t: {1,4}){
+        ImageView<u64> r = computeIntegralMulti(ImageView<u16>(img, w, h), ws, t);
+        assert(std::equal(ref.begin(), ref.end(), r.data));
+        r = defaultIntegralEngine(t)->computeStrips(ImageView<u16>(img, w, h), ws, t);
+        assert(std::equal(ref.begin(), ref.end(), r.data));
+    }
+}
+
+// Every task runs exactly once on at most the requested threads, also when some tasks are slow
+static void test_thread_pool_stealing(){
+    ThreadPool pool(4);
+    std::mt19937 rng(22);
+    for(int iter=0;iter<200;++iter){
+        size_t n = 1 + rng()%100;
+        int threads = 1 + static_cast<int>(rng()%5);
+        std::vector<std::atomic<int>> hits(n);
+        for(auto &h: hits) h.store(0);
+        std::mutex m;
+        std::vector<std::thread::id> ids;
+        size_t slow = rng()%n;
+        pool.run(n, [&](size_t i){
+            if(i == slow && iter%20 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            hits[i].fetch_add(1);
+            std::lock_guard<std::mutex> lk(m);
+            if(std::find(ids.begin(), ids.end(), std::this_thread::get_id()) == ids.end()) ids.push_back(std::this_thread::get_id());
+        }, threads);
+        for(auto &h: hits) assert(h.load()==1);
+        assert(ids.size() <= static_cast<size_t>(std::min(threads, 4)));
+    }
+}
+
+static void test_engine_reuse(){
+    IntegralEngine eng(3);
+    assert(eng.threads()==3);
+    std::mt19937 rng(5);
+    for(int i=0;i<50;++i){
+        unsigned w = 1 + rng()%300, h = 1 + rng()%60;
+        std::vector<u32> img(w*h);
+        for(auto &v: img) v = rng()%256;
+        std::vector<u64> A,B,C;
+        computeIntegralSingle(img,w,h,A);
+        eng.compute(img,w,h,B);
+        eng.computeStrips(img,w,h,C);
+        assert(A==B);
+        assert(A==C);
+    }
+    // free functions from several threads at once, with differing thread counts
+    std::vector<u32> img(200*100, 7);
+    std::vector<u64> ref;
+    computeIntegralSingle(img,200,100,ref);
+    std::vector<std::thread> callers;
+    for(int t=1;t<=4;++t) callers.emplace_back([&,t]{
+        std::vector<u64> out;
+        for(int r=0;r<20;++r){ computeIntegralMulti(img,200,100,out,t); assert(out==ref); }
+    });
+    for(auto &th: callers) th.join();
+}
+
+static void test_auto_plan(){
+    IntegralTuning saved = integralTuning();
+    IntegralTuning t{1000, 500, 16};
+    const char* path = "/tmp/integral_tuning_test.txt";
+    assert(saveIntegralTuning(path, t));
+    IntegralTuning u{0,0,0};
+    assert(loadIntegralTuning(path, u));
+    assert(u.parallel_min_pixels==1000 && u.pixels_per_thread==500 && u.min_band_rows==16);
+    std::remove(path);
+    assert(!loadIntegralTuning(path, u));
+
+    setIntegralTuning(t);
+    assert(planIntegral(10,10).method == IntegralMethod::Single);
+    if(std::thread::hardware_concurrency() > 1){
+        IntegralPlan p = planIntegral(1000,1000);
+        assert(p.method == IntegralMethod::Bands && p.threads > 1);
+        assert(planIntegral(10000,2).method == IntegralMethod::Strips);
+    }
+    for(auto sz: {std::make_pair(10u,10u), std::make_pair(300u,200u), std::make_pair(3000u,3u)}){
+        std::vector<u32> img(sz.first*sz.second, 3);
+        std::vector<u64> A,B;
+        computeIntegralSingle(img,sz.first,sz.second,A);
+        computeIntegralAuto(img,sz.first,sz.second,B);
+        assert(A==B);
+    }
+    setIntegralTuning(saved);
+}
+
+static void test_narrow_output(){
+    assert(integralMaxSum(4096,4096,8) == 4096ull*4096*255);
+    assert(integralMaxSum(size_t(1)<<40, size_t(1)<<40, 8) == ~u64(0));
+
+    std::mt19937 rng(11);
+    unsigned w=300, h=300;
+    std::vector<u16> img(w*h);
+    for(auto &v: img) v = static_cast<u16>(rng() & 0xFFF);
+    std::vector<u64> ref;
+    computeIntegralSingle(img,w,h,ref);
+
+    NarrowIntegral n12 = computeIntegralNarrow(img,w,h,12);
+    assert(!n12.wrapping && std::holds_alternative<std::vector<u32>>(n12.table));
+    const auto& t12 = std::get<std::vector<u32>>(n12.table);
+    for(size_t i=0;i<ref.size();++i) assert(t12[i]==ref[i]);
+
+    for(auto &v: img) v = static_cast<u16>(rng());
+    computeIntegralSingle(img,w,h,ref);
+    NarrowIntegral n16 = computeIntegralNarrow(img,w,h);
+    assert(!n16.wrapping && std::holds_alternative<std::vector<u64>>(n16.table));
+    assert(std::get<std::vector<u64>>(n16.table) == ref);
+
+    // wrapped u32 table: rectangles whose sum fits in u32 are still exact
+    NarrowIntegral nw = computeIntegralNarrow(img,w,h,0,true);
+    assert(nw.wrapping && std::holds_alternative<std::vector<u32>>(nw.table));
+    const auto& tw = std::get<std::vector<u32>>(nw.table);
+    for(int i=0;i<200;++i){
+        size_t x0 = rng()%w, y0 = rng()%h;
+        size_t x1 = std::min<size_t>(w-1, x0 + rng()%200), y1 = std::min<size_t>(h-1, y0 + rng()%200);
+        assert(integralRectSum(tw,w,x0,y0,x1,y1) == integralRectSum(ref,w,x0,y0,x1,y1));
+    }
+}
+
+static void test_strided_views(){
+    // ROI of a larger u8 frame into a padded output buffer
+    const size_t FW=97, FH=41, rx=5, ry=3, rw=70, rh=30, ostride=80;
+    std::mt19937 rng(21);
+    std::vector<u8> frame(FW*FH);
+    for(auto &v: frame) v = static_cast<u8>(rng());
+    ImageView<u8> roi = ImageView<u8>(frame, FW, FH).roi(rx, ry, rw, rh);
+
+    std::vector<u8> copy(rw*rh);
+    for(size_t y=0;y<rh;++y) for(size_t x=0;x<rw;++x) copy[y*rw + x] = roi(x, y);
+    std::vector<u32> ref;
+    computeIntegralSingle(copy, rw, rh, ref);
+
+    std::vector<u32> buf(ostride*rh, 0xDEADBEEF);
+    MutableImageView<u32> out(buf.data(), rw, rh, ostride*sizeof(u32));
+    auto check = [&]{
+        for(size_t y=0;y<rh;++y){
+            for(size_t x=0;x<rw;++x) assert(out(x, y) == ref[y*rw + x]);
+            for(size_t x=rw;x<ostride;++x) assert(buf[y*ostride + x] == 0xDEADBEEF); // padding untouched
+        }
+    };
+    computeIntegralSingle(roi, out); check();
+    computeIntegralMulti(roi, out, 4); check();
+    computeIntegralStrips(roi, out, 4); check();
+    computeIntegralAuto(roi, out); check();
+}
+
+static void test_workspace_reuse(){
+    IntegralWorkspace<u64> ws;
+    IntegralEngine eng(3);
+    std::mt19937 rng(8);
+    for(int i=0;i<20;++i){
+        unsigned w = 1 + rng()%200, h = 1 + rng()%100;
+        std::vector<u32> img(w*h);
+        for(auto &v: img) v = rng()%256;
+        std::vector<u64> ref;
+        computeIntegralSingle(img,w,h,ref);
+        for(int m=0;m<4;++m){
+            ImageView<u64> r;
+            if(m==0) r = computeIntegralSingle(ImageView<u32>(img,w,h), ws);
+            if(m==1) r = eng.compute(ImageView<u32>(img,w,h), ws);
+            if(m==2) r = eng.computeStrips(ImageView<u32>(img,w,h), ws);
+            if(m==3) r = computeIntegralAuto(ImageView<u32>(img,w,h), ws);
+            assert(r.width==w && r.height==h);
+            for(size_t y=0;y<h;++y) for(size_t x=0;x<w;++x) assert(r(x,y) == ref[y*w + x]);
+        }
+    }
+    // once sized, the workspace keeps its buffers
+    ws.reserve(200, 100, 3);
+    const u64* data = ws.result().data;
+    std::vector<u32> img(150*80, 1);
+    assert(eng.compute(ImageView<u32>(img,150,80), ws).data == data);
+}
+
+// Batched queries, on every kernel level and thread count and in both layouts,
+// against integralRectSum
+template<class Pixel, class Acc>
+static void test_rect_queries(){
+    std::mt19937 rng(55);
+    const size_t w = 37, h = 23, n = 1000;
+    std::vector<Pixel> img(w*h);
+    for(auto &v: img) v = static_cast<Pixel>(rng()%256);
+    std::vector<Acc> I;
+    computeIntegralSingle(img,w,h,I);
+    std::vector<u32> x0(n), y0(n), x1(n), y1(n);
+    for(size_t i=0;i<n;++i){
+        x0[i] = (i%5==0) ? 0 : rng()%w;  x1[i] = rng()%w;
+        y0[i] = (i%3==0) ? 0 : rng()%h;  y1[i] = rng()%h;
+        if(x0[i]>x1[i]) std::swap(x0[i],x1[i]);
+        if(y0[i]>y1[i]) std::swap(y0[i],y1[i]);
+    }
+    std::vector<Acc> ref(n);
+    for(size_t i=0;i<n;++i) ref[i] = integralRectSum(I, w, x0[i], y0[i], x1[i], y1[i]);
+    for(SimdLevel l: {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512}){
+        const RectKernels<Acc>* k = rectKernels<Acc>(l);
+        if(!k) continue;
+        for(size_t m: {n, n-1, size_t(3)}){
+            std::vector<Acc> out(m);
+            k->rectSums(I.data(), w, x0.data(), y0.data(), x1.data(), y1.data(), out.data(), m);
+            assert(std::equal(out.begin(), out.end(), ref.begin()));
+        }
+    }
+    RectQuery q{x0.data(), y0.data(), x1.data(), y1.data(), n};
+    for(int t: {1,2,4}){
+        std::vector<Acc> out;
+        computeRectSums(I, w, h, q, out, t);
+        assert(out == ref);
+    }
+
+    // ZeroPadded layout, packed and with cache-line rows
+    for(size_t align: {size_t(0), size_t(64)}){
+        std::vector<Acc, IntegralAllocator<Acc>> P(7, Acc(9));
+        ImageView<Acc> pv = computeIntegralPadded(img, w, h, P, align);
+        assert(pv.width == w+1 && pv.height == h+1 && pv.stride == paddedIntegralStride<Acc>(w, align));
+        assert(pv.stride % (align ? align : sizeof(Acc)) == 0);
+        if(align) for(size_t y=0;y<=h;++y) assert(reinterpret_cast<std::uintptr_t>(pv.row(y)) % align == 0);
+        for(size_t y=0;y<=h;++y) for(size_t x=0;x<=w;++x) assert(pv(x,y) == ((x && y) ? I[(y-1)*w + x-1] : Acc(0)));
+        for(size_t i=0;i<n;++i) assert(paddedRectSum(pv, x0[i], y0[i], x1[i], y1[i]) == ref[i]);
+        std::vector<Acc> out(n);
+        computeRectSums(pv, q, out.data(), 2, IntegralLayout::ZeroPadded);
+        assert(out == ref);
+        for(SimdLevel l: {SimdLevel::Scalar, SimdLevel::AVX2, SimdLevel::AVX512}){
+            const RectKernels<Acc>* k = rectKernels<Acc>(l);
+            if(!k) continue;
+            k->paddedRectSums(pv.data, pv.stride/sizeof(Acc), x0.data(), y0.data(), x1.data(), y1.data(), out.data(), n-1);
+            assert(std::equal(out.begin(), out.end()-1, ref.begin()));
+        }
+    }
+}
+
 static void test_rect_sum_property(){
     unsigned w=10,h=10;
     std::mt19937 rng(123);
@@ -60,6 +878,59 @@ int main(){
     cout << "Running tests...\n";
     test_small_known();
     for(unsigned s=0;s<5;++s) test_random_compare(32 + s*8, 16 + s*7, 1000+s);
+    test_tiled_bands();
+    test_simd_row_kernels<u8,u32>();
+    test_simd_row_kernels<u8,u64>();
+    test_simd_row_kernels<u16,u32>();
+    test_simd_row_kernels<u32,u32>();
+    test_simd_row_kernels<u16,u64>();
+    test_simd_row_kernels<u32,u64>();
+    test_simd_row_kernels<float,double>();
+    test_simd_row_kernels<double,double>();
+    test_pixel_types<u8,u32>();
+    test_pixel_types<u8,u64>();
+    test_pixel_types<u16,u32>();
+    test_pixel_types<u32,u32>();
+    test_pixel_types<u16,u64>();
+    test_pixel_types<u32,u64>();
+    test_pixel_types<float,double>();
+    test_squared_integral<u8,u32,u64>(255);
+    test_squared_integral<u16,u64,u64>(65535);
+    test_squared_integral<float,double,double>(255);
+    test_tilted_integral<u8,u32>();
+    test_tilted_integral<u16,u64>();
+    test_tilted_integral<float,double>();
+    test_box_filter<u8>();
+    test_box_filter<u16>();
+    test_box_filter<float>();
+    test_adaptive_threshold<u8>();
+    test_adaptive_threshold<u16>();
+    test_integral_histogram();
+    test_update_integral<u8,u32>();
+    test_update_integral<u16,u64>();
+    test_update_integral<float,double>();
+    test_streaming_integral<u8,u32>();
+    test_streaming_integral<u16,u64>();
+    test_streaming_integral<float,double>();
+    test_integral_file();
+    test_multichannel_integral<u32>();
+    test_multichannel_integral<u64>();
+    test_mapped_files();
+    test_integral_batch();
+    test_thread_pool_stealing();
+    test_lookback_integral<u8,u32>();
+    test_lookback_integral<u16,u64>();
+    test_lookback_integral<float,double>();
+    test_numa_engine();
+    test_buffers();
+    test_engine_reuse();
+    test_auto_plan();
+    test_narrow_output();
+    test_strided_views();
+    test_workspace_reuse();
+    test_rect_queries<u32,u32>();
+    test_rect_queries<u32,u64>();
+    test_rect_queries<float,double>();
     test_rect_sum_property();
     cout << "All tests passed."<<endl;
     return 0;